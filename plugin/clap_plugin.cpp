@@ -0,0 +1,583 @@
+// The engine as a CLAP instrument. The host owns the audio thread and the
+// block size: process() takes the note and parameter events of the host's
+// list at their sample, rendering the frames in between with
+// SynthEngine::renderFrames(), and does not allocate. Every instance has an
+// engine of its own, so the host can run them in parallel.
+//
+//   cmake -S . -B build -DCLAP_INCLUDE_DIR=path/to/clap/include && cmake --build build
+//   clap-validator validate build/Synthesizer.clap
+//   ./build/clap_render build/Synthesizer.clap out.wav
+#include <clap/clap.h>
+#include "engine.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// MIDI A4 is 69, the engine's is 57
+static const int keyToPitch = -12;
+
+enum class ClapParam
+{
+	Volume,
+	Brillance,
+	Cutoff,
+	Q,
+	WaveShape,
+	Oversampling,
+	sizeParams,
+};
+
+typedef struct{
+	const char* name;
+	double minValue;
+	double maxValue;
+	double defaultValue;
+	bool stepped;
+} s_clap_param;
+
+// the defaults of SynthEngine::setup(); the ids are the indices
+static const s_clap_param clapParams[] = {
+	{"Volume", 0., 1., 0.1, false},
+	{"Brillance", 1., 200., 1., true},
+	{"Cutoff", 20., 20000., 500., false},
+	{"Q", 0.05, 10., 0.1, false},
+	{"Wave shape", 0., 2., 0., true},
+	{"Oversampling", 0., 3., 0., true},	// 1x, 2x, 4x, 8x
+};
+static constexpr int numClapParams = static_cast<int>(ClapParam::sizeParams);
+static const char* waveShapeNames[] = {"sin", "square", "saw"};
+
+static const uint32_t clapStateVersion = 1;
+
+static const char* clapFeatures[] = {CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_SYNTHESIZER, CLAP_PLUGIN_FEATURE_STEREO, nullptr};
+
+static const clap_plugin_descriptor_t clapDescriptor = {
+	CLAP_VERSION_INIT,
+	"org.parentn.synthesizer",
+	"Synthesizer",
+	"parentn",
+	"https://github.com/parentn/Synthesizer",
+	"",
+	"",
+	"1.0.0",
+	"Additive oscillators, resonant filter, modulation matrix and limiter",
+	clapFeatures,
+};
+
+class ClapSynth{
+
+	public:
+
+		ClapSynth(const clap_host_t* host);
+
+		clap_plugin_t plugin;
+
+		bool activate(double sampleRate, uint32_t maxFrames);
+		void deactivate();
+		void reset();
+		clap_process_status process(const clap_process_t* process);
+		void flush(const clap_input_events_t* events);
+
+		bool getValue(clap_id id, double& value) const;
+		bool save(const clap_ostream_t* stream) const;
+		bool load(const clap_istream_t* stream);
+		uint32_t latency() const;
+
+	private:
+
+		void applyEvent(const clap_event_header_t* header);
+		void applyParameter(int id, double value);
+		void applyNote(int key, double velocity, bool on);
+		void applyPendingParameters();
+		uint32_t engineLatency() const;
+
+		const clap_host_t* mHost;
+		const clap_host_latency_t* mHostLatency = nullptr;
+		SynthEngine mEngine;
+		bool mActive = false;
+		uint32_t mLatency = 0;						// reported to the host, fixed while active
+		std::atomic<bool> mRestartRequested{false};
+
+		// written by the audio thread, or by load() and flush() while it is
+		// idle; read by the main thread
+		std::atomic<double> mValues[numClapParams];
+		std::atomic<bool> mValuesLoaded{false};	// load() changed them, process() applies them
+};
+
+//--------------------------------------------------------------
+static ClapSynth* self(const clap_plugin_t* plugin){
+	return static_cast<ClapSynth*>(plugin->plugin_data);
+}
+
+//--------------------------------------------------------------
+ClapSynth::ClapSynth(const clap_host_t* host) : mHost(host){
+	for (int p = 0; p < numClapParams; p++){
+		mValues[p].store(clapParams[p].defaultValue);
+	}
+	plugin.desc = &clapDescriptor;
+	plugin.plugin_data = this;
+	plugin.init = [](const clap_plugin_t* plugin){
+		ClapSynth* synth = self(plugin);
+		synth->mHostLatency = static_cast<const clap_host_latency_t*>(synth->mHost->get_extension(synth->mHost, CLAP_EXT_LATENCY));
+		return true;
+	};
+	plugin.destroy = [](const clap_plugin_t* plugin){
+		ClapSynth* synth = self(plugin);
+		synth->deactivate();
+		delete synth;
+	};
+	plugin.activate = [](const clap_plugin_t* plugin, double sampleRate, uint32_t, uint32_t maxFrames){
+		return self(plugin)->activate(sampleRate, maxFrames);
+	};
+	plugin.deactivate = [](const clap_plugin_t* plugin){ self(plugin)->deactivate(); };
+	plugin.start_processing = [](const clap_plugin_t*){ return true; };
+	plugin.stop_processing = [](const clap_plugin_t*){};
+	plugin.reset = [](const clap_plugin_t* plugin){ self(plugin)->reset(); };
+	plugin.process = [](const clap_plugin_t* plugin, const clap_process_t* process){
+		return self(plugin)->process(process);
+	};
+	plugin.get_extension = [](const clap_plugin_t*, const char* id) -> const void* {
+		static const clap_plugin_audio_ports_t audioPorts = {
+			[](const clap_plugin_t*, bool isInput) -> uint32_t { return isInput ? 0 : 1; },
+			[](const clap_plugin_t*, uint32_t index, bool isInput, clap_audio_port_info_t* info){
+				if (isInput || index != 0){
+					return false;
+				}
+				info->id = 0;
+				snprintf(info->name, sizeof(info->name), "%s", "Master");
+				info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+				info->channel_count = 2;
+				info->port_type = CLAP_PORT_STEREO;
+				info->in_place_pair = CLAP_INVALID_ID;
+				return true;
+			},
+		};
+		static const clap_plugin_note_ports_t notePorts = {
+			[](const clap_plugin_t*, bool isInput) -> uint32_t { return isInput ? 1 : 0; },
+			[](const clap_plugin_t*, uint32_t index, bool isInput, clap_note_port_info_t* info){
+				if (!isInput || index != 0){
+					return false;
+				}
+				info->id = 0;
+				info->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI;
+				info->preferred_dialect = CLAP_NOTE_DIALECT_CLAP;
+				snprintf(info->name, sizeof(info->name), "%s", "Notes");
+				return true;
+			},
+		};
+		static const clap_plugin_latency_t latency = {
+			[](const clap_plugin_t* plugin){ return self(plugin)->latency(); },
+		};
+		static const clap_plugin_params_t params = {
+			[](const clap_plugin_t*) -> uint32_t { return numClapParams; },
+			[](const clap_plugin_t*, uint32_t index, clap_param_info_t* info){
+				if (index >= uint32_t(numClapParams)){
+					return false;
+				}
+				const s_clap_param& param = clapParams[index];
+				memset(info, 0, sizeof(*info));
+				info->id = index;
+				info->flags = CLAP_PARAM_IS_AUTOMATABLE | (param.stepped ? CLAP_PARAM_IS_STEPPED : 0);
+				snprintf(info->name, sizeof(info->name), "%s", param.name);
+				info->min_value = param.minValue;
+				info->max_value = param.maxValue;
+				info->default_value = param.defaultValue;
+				return true;
+			},
+			[](const clap_plugin_t* plugin, clap_id id, double* value){
+				return self(plugin)->getValue(id, *value);
+			},
+			[](const clap_plugin_t*, clap_id id, double value, char* text, uint32_t capacity){
+				switch (static_cast<ClapParam>(id)){
+					case ClapParam::Volume:
+						snprintf(text, capacity, "%.1f dB", 20. * log10(std::max(value, 1e-5)));
+						return true;
+					case ClapParam::Brillance:
+						snprintf(text, capacity, "%d", int(value));
+						return true;
+					case ClapParam::Cutoff:
+						snprintf(text, capacity, "%.0f Hz", value);
+						return true;
+					case ClapParam::Q:
+						snprintf(text, capacity, "%.2f", value);
+						return true;
+					case ClapParam::WaveShape:
+						snprintf(text, capacity, "%s", waveShapeNames[std::clamp(int(value), 0, 2)]);
+						return true;
+					case ClapParam::Oversampling:
+						snprintf(text, capacity, "%dx", 1 << std::clamp(int(value), 0, 3));
+						return true;
+					default:
+						return false;
+				}
+			},
+			[](const clap_plugin_t*, clap_id id, const char* text, double* value){
+				if (id >= uint32_t(numClapParams)){
+					return false;
+				}
+				if (static_cast<ClapParam>(id) == ClapParam::WaveShape){
+					for (int s = 0; s < 3; s++){
+						if (strcmp(text, waveShapeNames[s]) == 0){
+							*value = s;
+							return true;
+						}
+					}
+				}
+				char* end = nullptr;
+				double parsed = strtod(text, &end);
+				if (end == text){
+					return false;
+				}
+				if (static_cast<ClapParam>(id) == ClapParam::Volume){
+					parsed = pow(10., parsed / 20.);	// written in dB
+				} else if (static_cast<ClapParam>(id) == ClapParam::Oversampling){
+					parsed = log2(std::max(parsed, 1.));	// written as a factor
+				}
+				*value = std::clamp(parsed, clapParams[id].minValue, clapParams[id].maxValue);
+				return true;
+			},
+			[](const clap_plugin_t* plugin, const clap_input_events_t* in, const clap_output_events_t*){
+				self(plugin)->flush(in);
+			},
+		};
+		// offline, there is no deadline: the governor keeps the full quality
+		static const clap_plugin_render_t render = {
+			[](const clap_plugin_t*){ return false; },
+			[](const clap_plugin_t* plugin, clap_plugin_render_mode mode){
+				self(plugin)->mEngine.governed.store(mode != CLAP_RENDER_OFFLINE, std::memory_order_relaxed);
+				return true;
+			},
+		};
+		static const clap_plugin_state_t state = {
+			[](const clap_plugin_t* plugin, const clap_ostream_t* stream){ return self(plugin)->save(stream); },
+			[](const clap_plugin_t* plugin, const clap_istream_t* stream){ return self(plugin)->load(stream); },
+		};
+		if (strcmp(id, CLAP_EXT_AUDIO_PORTS) == 0){
+			return &audioPorts;
+		} else if (strcmp(id, CLAP_EXT_NOTE_PORTS) == 0){
+			return &notePorts;
+		} else if (strcmp(id, CLAP_EXT_LATENCY) == 0){
+			return &latency;
+		} else if (strcmp(id, CLAP_EXT_PARAMS) == 0){
+			return &params;
+		} else if (strcmp(id, CLAP_EXT_STATE) == 0){
+			return &state;
+		} else if (strcmp(id, CLAP_EXT_RENDER) == 0){
+			return &render;
+		}
+		return nullptr;
+	};
+	plugin.on_main_thread = [](const clap_plugin_t*){};
+}
+
+//--------------------------------------------------------------
+bool ClapSynth::activate(double sampleRate, uint32_t maxFrames){
+	// main thread: everything process() touches is allocated here, for
+	// blocks of up to maxFrames; longer ones would be rendered in chunks
+	deactivate();
+	mEngine.frontEnd = false;
+	mEngine.setup(std::max<uint32_t>(maxFrames, 1), size_t(sampleRate));
+	for (int p = 0; p < numClapParams; p++){
+		applyParameter(p, mValues[p].load());
+	}
+	mValuesLoaded.store(false);
+	uint32_t latency = engineLatency();
+	bool latencyChanged = (latency != mLatency);
+	mLatency = latency;
+	if (latencyChanged && mHostLatency != nullptr){
+		mHostLatency->changed(mHost);
+	}
+	mRestartRequested.store(false);
+	mActive = true;
+	return true;
+}
+
+//--------------------------------------------------------------
+void ClapSynth::deactivate(){
+	if (mActive){
+		mEngine.close();
+		mActive = false;
+	}
+}
+
+//--------------------------------------------------------------
+void ClapSynth::reset(){
+	for (auto& signal : mEngine.signalsNotes){
+		signal.volume = 0.f;
+	}
+}
+
+//--------------------------------------------------------------
+uint32_t ClapSynth::latency() const {
+	return mLatency;
+}
+
+//--------------------------------------------------------------
+// The lookahead of the master limiter, and the group delay of the
+// decimation cascade at the oversampling factor applied by activate(). The
+// governor's NoOversampling tier shortens the latter while it holds.
+uint32_t ClapSynth::engineLatency() const {
+	return uint32_t(mEngine.limiter.latency() + mEngine.lOversampler.latency(mEngine.oversamplingFactor));
+}
+
+//--------------------------------------------------------------
+clap_process_status ClapSynth::process(const clap_process_t* process){
+	if (process->audio_outputs_count < 1 || process->audio_outputs[0].channel_count < 2 || process->audio_outputs[0].data32 == nullptr){
+		return CLAP_PROCESS_ERROR;
+	}
+	applyPendingParameters();
+	// the load of the whole callback against its own deadline, the
+	// governor is updated once per callback whatever the events
+	mEngine.beginBlock();
+
+	// the events are sorted by time: the frames before each of them are
+	// rendered first, so that it takes effect at its sample
+	float** outputs = process->audio_outputs[0].data32;
+	const uint32_t numFrames = process->frames_count;
+	const uint32_t numEvents = process->in_events->size(process->in_events);
+	uint32_t rendered = 0;
+	for (uint32_t e = 0; e < numEvents; e++){
+		const clap_event_header_t* header = process->in_events->get(process->in_events, e);
+		uint32_t time = std::min(header->time, numFrames);
+		if (time > rendered){
+			float* const chunk[2] = {outputs[0] + rendered, outputs[1] + rendered};
+			mEngine.renderFrames(chunk, 2, time - rendered);
+			rendered = time;
+		}
+		applyEvent(header);
+	}
+	if (numFrames > rendered){
+		float* const chunk[2] = {outputs[0] + rendered, outputs[1] + rendered};
+		mEngine.renderFrames(chunk, 2, numFrames - rendered);
+	}
+	mEngine.endBlock(numFrames);
+	process->audio_outputs[0].constant_mask = 0;
+	return CLAP_PROCESS_CONTINUE;
+}
+
+//--------------------------------------------------------------
+void ClapSynth::flush(const clap_input_events_t* events){
+	// parameter changes while the host does not process, never during
+	// process(); before activate() the values are only kept
+	applyPendingParameters();
+	const uint32_t numEvents = events->size(events);
+	for (uint32_t e = 0; e < numEvents; e++){
+		const clap_event_header_t* header = events->get(events, e);
+		if (header->space_id == CLAP_CORE_EVENT_SPACE_ID && header->type == CLAP_EVENT_PARAM_VALUE){
+			applyEvent(header);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void ClapSynth::applyEvent(const clap_event_header_t* header){
+	if (header->space_id != CLAP_CORE_EVENT_SPACE_ID){
+		return;
+	}
+	switch (header->type){
+		case CLAP_EVENT_NOTE_ON:{
+			const clap_event_note_t* note = reinterpret_cast<const clap_event_note_t*>(header);
+			applyNote(note->key, note->velocity, true);
+			break;
+		}
+		case CLAP_EVENT_NOTE_OFF:
+		case CLAP_EVENT_NOTE_CHOKE:{
+			const clap_event_note_t* note = reinterpret_cast<const clap_event_note_t*>(header);
+			applyNote(note->key, 0., false);
+			break;
+		}
+		case CLAP_EVENT_PARAM_VALUE:{
+			const clap_event_param_value_t* param = reinterpret_cast<const clap_event_param_value_t*>(header);
+			if (param->param_id < uint32_t(numClapParams)){
+				const s_clap_param& info = clapParams[param->param_id];
+				double value = std::clamp(param->value, info.minValue, info.maxValue);
+				mValues[param->param_id].store(value, std::memory_order_relaxed);
+				if (mActive){
+					applyParameter(param->param_id, value);
+				}
+			}
+			break;
+		}
+		case CLAP_EVENT_MIDI:{
+			const clap_event_midi_t* midi = reinterpret_cast<const clap_event_midi_t*>(header);
+			int status = midi->data[0] & 0xF0;
+			if (status == 0x90 && midi->data[2] > 0){
+				applyNote(midi->data[1], midi->data[2] / 127., true);
+			} else if (status == 0x80 || status == 0x90){
+				applyNote(midi->data[1], 0., false);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+//--------------------------------------------------------------
+// The engine has one voice per pitch class, so notes of the same pitch
+// class are monophonic: C4 takes the voice of a held C3. A note off only
+// releases the voice while it still plays that key, releasing C3 then
+// leaves C4 alone.
+void ClapSynth::applyNote(int key, double velocity, bool on){
+	// key -1 is a wildcard: every note
+	if (key < 0){
+		if (!on){
+			reset();
+		}
+		return;
+	}
+	const int pitch = key + keyToPitch;
+	const int note = ((pitch % SynthEngine::numNotes) + SynthEngine::numNotes) % SynthEngine::numNotes;
+	if (!on && mEngine.signalsNotes[note].frequency != pitchToFrequency(pitch)){
+		return;
+	}
+	s_synth_command command;
+	command.type = on ? SynthCommandType::NoteOn : SynthCommandType::NoteOff;
+	command.intValue = pitch;
+	command.value = float(velocity) * mEngine.volume;
+	mEngine.applyCommand(command);
+}
+
+//--------------------------------------------------------------
+// The same commands as OSC, see SynthEngine::applyCommand, except the
+// oversampling factor which has no command.
+void ClapSynth::applyParameter(int id, double value){
+	s_synth_command command;
+	command.value = float(value);
+	command.intValue = int(lround(value));
+	switch (static_cast<ClapParam>(id)){
+		case ClapParam::Volume:
+			command.type = SynthCommandType::Volume;
+			break;
+		case ClapParam::Brillance:
+			command.type = SynthCommandType::Brillance;
+			break;
+		case ClapParam::Cutoff:
+			command.type = SynthCommandType::FilterCutoff;
+			break;
+		case ClapParam::Q:
+			command.type = SynthCommandType::FilterQ;
+			break;
+		case ClapParam::WaveShape:
+			command.type = SynthCommandType::WaveShape;
+			command.intValue = std::clamp(command.intValue, 0, 2);
+			break;
+		case ClapParam::Oversampling:{
+			// the factor sets the latency, which may only change while
+			// deactivated: the host restarts the plugin, and activate()
+			// applies the factor and reports the new latency together
+			int factor = 1 << std::clamp(command.intValue, 0, 3);
+			if (!mActive){
+				mEngine.oversamplingFactor = factor;
+			} else if (factor != mEngine.oversamplingFactor && !mRestartRequested.exchange(true)){
+				mHost->request_restart(mHost);
+			}
+			return;
+		}
+		default:
+			return;
+	}
+	mEngine.applyCommand(command);
+}
+
+//--------------------------------------------------------------
+void ClapSynth::applyPendingParameters(){
+	if (mActive && mValuesLoaded.exchange(false, std::memory_order_acquire)){
+		for (int p = 0; p < numClapParams; p++){
+			applyParameter(p, mValues[p].load(std::memory_order_relaxed));
+		}
+	}
+}
+
+//--------------------------------------------------------------
+bool ClapSynth::getValue(clap_id id, double& value) const {
+	if (id >= uint32_t(numClapParams)){
+		return false;
+	}
+	value = mValues[id].load(std::memory_order_relaxed);
+	return true;
+}
+
+//--------------------------------------------------------------
+// State: the version, the number of values, then the values as doubles.
+bool ClapSynth::save(const clap_ostream_t* stream) const {
+	uint32_t header[2] = {clapStateVersion, uint32_t(numClapParams)};
+	double values[numClapParams];
+	for (int p = 0; p < numClapParams; p++){
+		values[p] = mValues[p].load(std::memory_order_relaxed);
+	}
+	auto write = [stream](const void* data, uint64_t size){
+		const char* bytes = static_cast<const char*>(data);
+		while (size > 0){
+			int64_t written = stream->write(stream, bytes, size);
+			if (written <= 0){
+				return false;
+			}
+			bytes += written;
+			size -= written;
+		}
+		return true;
+	};
+	return write(header, sizeof(header)) && write(values, sizeof(values));
+}
+
+//--------------------------------------------------------------
+bool ClapSynth::load(const clap_istream_t* stream){
+	auto read = [stream](void* data, uint64_t size){
+		char* bytes = static_cast<char*>(data);
+		while (size > 0){
+			int64_t count = stream->read(stream, bytes, size);
+			if (count <= 0){
+				return false;
+			}
+			bytes += count;
+			size -= count;
+		}
+		return true;
+	};
+	uint32_t header[2];
+	if (!read(header, sizeof(header)) || header[0] != clapStateVersion || header[1] > 1024){
+		return false;
+	}
+	// values added by later versions are ignored, missing ones keep their default
+	for (uint32_t p = 0; p < header[1]; p++){
+		double value;
+		if (!read(&value, sizeof(value))){
+			return false;
+		}
+		if (p < uint32_t(numClapParams)){
+			mValues[p].store(std::clamp(value, clapParams[p].minValue, clapParams[p].maxValue), std::memory_order_relaxed);
+		}
+	}
+	for (uint32_t p = header[1]; p < uint32_t(numClapParams); p++){
+		mValues[p].store(clapParams[p].defaultValue, std::memory_order_relaxed);
+	}
+	mValuesLoaded.store(true, std::memory_order_release);
+	return true;
+}
+
+//--------------------------------------------------------------
+static const clap_plugin_factory_t clapFactory = {
+	[](const clap_plugin_factory_t*) -> uint32_t { return 1; },
+	[](const clap_plugin_factory_t*, uint32_t index) -> const clap_plugin_descriptor_t* {
+		return (index == 0) ? &clapDescriptor : nullptr;
+	},
+	[](const clap_plugin_factory_t*, const clap_host_t* host, const char* id) -> const clap_plugin_t* {
+		if (!clap_version_is_compatible(host->clap_version) || strcmp(id, clapDescriptor.id) != 0){
+			return nullptr;
+		}
+		return &(new ClapSynth(host))->plugin;
+	},
+};
+
+extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+	CLAP_VERSION_INIT,
+	[](const char*){ return true; },
+	[](){},
+	[](const char* id) -> const void* {
+		return (strcmp(id, CLAP_PLUGIN_FACTORY_ID) == 0) ? &clapFactory : nullptr;
+	},
+};
@@ -0,0 +1,236 @@
+#include "dsp_kernels.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__)
+#define DSP_INLINE static inline __attribute__((always_inline))
+#else
+#define DSP_INLINE static inline
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_HAS_X86_VARIANTS 1
+#endif
+
+//--------------------------------------------------------------
+// Kernel bodies. They are written without branches nor loop-carried
+// dependencies in the inner loops, so that each target below vectorizes
+// them with its own vector width.
+//--------------------------------------------------------------
+DSP_INLINE float polySin(float x){
+	const float pi = 3.14159265358979f;
+	const float invPi = 0.318309886183791f;
+	// sin(x) = (-1)^k sin(x - k pi) with k the nearest half turn, so the
+	// polynomial only sees [-pi/2, pi/2]. The bias makes the truncating
+	// conversion round down for any x above -1024 half turns.
+	int k = (int) (x * invPi + 1024.5f) - 1024;
+	float r = x - (float) k * pi;
+	float sign = 1.f - 2.f * (float) (k & 1);
+	float r2 = r * r;
+	return sign * r * (1.f + r2 * (-1.f / 6.f + r2 * (1.f / 120.f + r2 * (-1.f / 5040.f + r2 * (1.f / 362880.f + r2 * (-1.f / 39916800.f))))));
+}
+
+DSP_INLINE void additiveBody(const float* __restrict phases, size_t numFrames, const float* __restrict multipliers,
+	const float* __restrict amplitudes, int numHarmonics, float* __restrict out){
+	for (size_t i = 0; i < numFrames; i++){
+		out[i] = 0.f;
+	}
+	for (int k = 0; k < numHarmonics; k++){
+		const float m = multipliers[k];
+		const float a = amplitudes[k];
+		for (size_t i = 0; i < numFrames; i++){
+			out[i] += a * polySin(m * phases[i]);
+		}
+	}
+}
+
+DSP_INLINE void biquadBody(const float* __restrict input, float* __restrict output, size_t numFrames,
+	float b_0, float b_1, float b_2, float a_1, float a_2, float* state){
+	float x_1 = state[0], x_2 = state[1], y_1 = state[2], y_2 = state[3];
+	for (size_t i = 0; i < numFrames; i++){
+		float x = input[i];
+		float y = b_0 * x + b_1 * x_1 + b_2 * x_2 - a_1 * y_1 - a_2 * y_2;
+		x_2 = x_1;
+		x_1 = x;
+		y_2 = y_1;
+		y_1 = y;
+		output[i] = y;
+	}
+	state[0] = x_1;
+	state[1] = x_2;
+	state[2] = y_1;
+	state[3] = y_2;
+}
+
+DSP_INLINE void biquadRampBody(const float* __restrict input, float* __restrict output, size_t numFrames,
+	const float* __restrict from, const float* __restrict to, float* state){
+	float x_1 = state[0], x_2 = state[1], y_1 = state[2], y_2 = state[3];
+	const float step = numFrames > 0 ? 1.f / numFrames : 0.f;
+	float c[5], dc[5];
+	for (int k = 0; k < 5; k++){
+		c[k] = from[k];
+		dc[k] = (to[k] - from[k]) * step;
+	}
+	for (size_t i = 0; i < numFrames; i++){
+		for (int k = 0; k < 5; k++){
+			c[k] += dc[k];
+		}
+		float x = input[i];
+		float y = c[0] * x + c[1] * x_1 + c[2] * x_2 - c[3] * y_1 - c[4] * y_2;
+		x_2 = x_1;
+		x_1 = x;
+		y_2 = y_1;
+		y_1 = y;
+		output[i] = y;
+	}
+	state[0] = x_1;
+	state[1] = x_2;
+	state[2] = y_1;
+	state[3] = y_2;
+}
+
+DSP_INLINE void mixStereoBody(const float* __restrict src, float gainL, float gainR,
+	float* __restrict left, float* __restrict right, size_t numFrames){
+	for (size_t i = 0; i < numFrames; i++){
+		left[i] += src[i] * gainL;
+		right[i] += src[i] * gainR;
+	}
+}
+
+DSP_INLINE void mixGrainBody(const float* __restrict source, uint32_t mask, uint32_t base, float position, float increment,
+	const float* __restrict window, float windowPhase, float windowIncrement,
+	float gainL, float gainR, float* __restrict left, float* __restrict right, int numFrames){
+	// positions are recomputed from the frame index rather than accumulated
+	for (int i = 0; i < numFrames; i++){
+		float p = position + i * increment;
+		int whole = (int) p;
+		float frac = p - whole;
+		uint32_t index = base + whole;
+		float a = source[index & mask];
+		float b = source[(index + 1) & mask];
+		float sample = (a + frac * (b - a)) * window[(int) (windowPhase + i * windowIncrement)];
+		left[i] += sample * gainL;
+		right[i] += sample * gainR;
+	}
+}
+
+DSP_INLINE void halfBandBody(const float* __restrict even, const float* __restrict odd, const float* __restrict coefficients,
+	int numTaps, float* __restrict output, size_t outputFrames){
+	const float* centre = odd + numTaps - 1;
+	for (size_t n = 0; n < outputFrames; n++){
+		output[n] = 0.5f * centre[n];
+	}
+	for (int j = 0; j < numTaps; j++){
+		const float c = coefficients[j];
+		const float* early = even + j;
+		const float* late = even + 2 * numTaps - 1 - j;
+		for (size_t n = 0; n < outputFrames; n++){
+			output[n] += c * (early[n] + late[n]);
+		}
+	}
+}
+
+DSP_INLINE void fftBody(float* __restrict re, float* __restrict im, size_t size,
+	const float* __restrict twiddleRe, const float* __restrict twiddleIm){
+	for (size_t half = 1; half < size; half *= 2){
+		const float* wr = twiddleRe + half - 1;
+		const float* wi = twiddleIm + half - 1;
+		for (size_t start = 0; start < size; start += 2 * half){
+			float* __restrict re0 = re + start;
+			float* __restrict im0 = im + start;
+			float* __restrict re1 = re + start + half;
+			float* __restrict im1 = im + start + half;
+			for (size_t j = 0; j < half; j++){
+				float tr = re1[j] * wr[j] - im1[j] * wi[j];
+				float ti = re1[j] * wi[j] + im1[j] * wr[j];
+				re1[j] = re0[j] - tr;
+				im1[j] = im0[j] - ti;
+				re0[j] += tr;
+				im0[j] += ti;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+// One table per instruction set. The attribute makes the compiler inline
+// the bodies above and generate them for that target only.
+//--------------------------------------------------------------
+#define DSP_DEFINE_KERNELS(suffix, label, attributes) \
+	attributes static void additive_##suffix(const float* phases, size_t numFrames, const float* multipliers, \
+		const float* amplitudes, int numHarmonics, float* out){ \
+		additiveBody(phases, numFrames, multipliers, amplitudes, numHarmonics, out); } \
+	attributes static void biquad_##suffix(const float* input, float* output, size_t numFrames, \
+		float b_0, float b_1, float b_2, float a_1, float a_2, float* state){ \
+		biquadBody(input, output, numFrames, b_0, b_1, b_2, a_1, a_2, state); } \
+	attributes static void biquadRamp_##suffix(const float* input, float* output, size_t numFrames, \
+		const float* from, const float* to, float* state){ \
+		biquadRampBody(input, output, numFrames, from, to, state); } \
+	attributes static void mixStereo_##suffix(const float* src, float gainL, float gainR, float* left, float* right, size_t numFrames){ \
+		mixStereoBody(src, gainL, gainR, left, right, numFrames); } \
+	attributes static void mixGrain_##suffix(const float* source, uint32_t mask, uint32_t base, float position, float increment, \
+		const float* window, float windowPhase, float windowIncrement, float gainL, float gainR, float* left, float* right, int numFrames){ \
+		mixGrainBody(source, mask, base, position, increment, window, windowPhase, windowIncrement, gainL, gainR, left, right, numFrames); } \
+	attributes static void halfBand_##suffix(const float* even, const float* odd, const float* coefficients, int numTaps, \
+		float* output, size_t outputFrames){ \
+		halfBandBody(even, odd, coefficients, numTaps, output, outputFrames); } \
+	attributes static void fft_##suffix(float* re, float* im, size_t size, const float* twiddleRe, const float* twiddleIm){ \
+		fftBody(re, im, size, twiddleRe, twiddleIm); } \
+	static const s_dsp_kernels kernels_##suffix = { label, additive_##suffix, biquad_##suffix, biquadRamp_##suffix, mixStereo_##suffix, \
+		mixGrain_##suffix, halfBand_##suffix, fft_##suffix };
+
+DSP_DEFINE_KERNELS(scalar, "scalar", )
+#ifdef DSP_HAS_X86_VARIANTS
+DSP_DEFINE_KERNELS(sse41, "sse4.1", __attribute__((target("sse4.1"))))
+DSP_DEFINE_KERNELS(avx2, "avx2", __attribute__((target("avx2,fma"))))
+DSP_DEFINE_KERNELS(avx512, "avx512", __attribute__((target("avx512f,avx512vl,avx512dq,avx2,fma"))))
+#endif
+
+//--------------------------------------------------------------
+const s_dsp_kernels* dspKernelsFor(DspIsa isa){
+	switch (isa){
+		case DspIsa::Scalar:
+			return &kernels_scalar;
+#ifdef DSP_HAS_X86_VARIANTS
+		case DspIsa::Sse41:
+			return __builtin_cpu_supports("sse4.1") ? &kernels_sse41 : nullptr;
+		case DspIsa::Avx2:
+			return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? &kernels_avx2 : nullptr;
+		case DspIsa::Avx512:
+			return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+				&& __builtin_cpu_supports("avx512dq")) ? &kernels_avx512 : nullptr;
+#endif
+		default:
+			return nullptr;
+	}
+}
+
+//--------------------------------------------------------------
+static const s_dsp_kernels* selectKernels(){
+#ifdef DSP_HAS_X86_VARIANTS
+	__builtin_cpu_init();
+#endif
+	// SYNTH_DSP_ISA=scalar|sse4.1|avx2|avx512 caps the choice, to compare variants
+	int limit = static_cast<int>(DspIsa::sizeIsa) - 1;
+	if (const char* forced = getenv("SYNTH_DSP_ISA")){
+		static const char* names[] = {"scalar", "sse4.1", "avx2", "avx512"};
+		for (int isa = 0; isa < static_cast<int>(DspIsa::sizeIsa); isa++){
+			if (strcmp(forced, names[isa]) == 0){
+				limit = isa;
+			}
+		}
+	}
+	for (int isa = limit; isa > 0; isa--){
+		if (const s_dsp_kernels* kernels = dspKernelsFor(static_cast<DspIsa>(isa))){
+			return kernels;
+		}
+	}
+	return &kernels_scalar;
+}
+
+//--------------------------------------------------------------
+const s_dsp_kernels& dspKernels(){
+	static const s_dsp_kernels* selected = selectKernels();
+	return *selected;
+}
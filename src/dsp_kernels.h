@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Hot DSP loops, compiled once per instruction set in the same binary. The
+// widest variant the CPU supports is picked at the first call of
+// dspKernels() and every caller goes through the function pointers.
+typedef struct{
+	const char* name;
+
+	// oscillators: out[i] = sum over k of amplitudes[k] * sin(multipliers[k] * phases[i])
+	void (*additive)(const float* phases, size_t numFrames, const float* multipliers, const float* amplitudes,
+		int numHarmonics, float* out);
+
+	// filters: direct form I biquad, state is {x_1, x_2, y_1, y_2}
+	void (*biquad)(const float* input, float* output, size_t numFrames,
+		float b_0, float b_1, float b_2, float a_1, float a_2, float* state);
+
+	// filters: the same biquad with coefficients moving linearly across the
+	// block, from and to are {b_0, b_1, b_2, a_1, a_2}
+	void (*biquadRamp)(const float* input, float* output, size_t numFrames,
+		const float* from, const float* to, float* state);
+
+	// mixing: left += src * gainL, right += src * gainR
+	void (*mixStereo)(const float* src, float gainL, float gainR, float* left, float* right, size_t numFrames);
+
+	// mixing: one grain read with linear interpolation from a looping source
+	void (*mixGrain)(const float* source, uint32_t mask, uint32_t base, float position, float increment,
+		const float* window, float windowPhase, float windowIncrement,
+		float gainL, float gainR, float* left, float* right, int numFrames);
+
+	// oversampling: folded half-band taps, see HalfBandDecimator
+	void (*halfBand)(const float* even, const float* odd, const float* coefficients, int numTaps,
+		float* output, size_t outputFrames);
+
+	// FFT: in place radix-2 on split real/imaginary arrays, input already in
+	// bit reversed order, twiddles stored stage after stage
+	void (*fft)(float* re, float* im, size_t size, const float* twiddleRe, const float* twiddleIm);
+} s_dsp_kernels;
+
+enum class DspIsa
+{
+	Scalar,
+	Sse41,
+	Avx2,
+	Avx512,
+	sizeIsa,
+};
+
+const s_dsp_kernels& dspKernels();
+
+// the kernels of a given instruction set, nullptr if the CPU lacks it
+const s_dsp_kernels* dspKernelsFor(DspIsa isa);
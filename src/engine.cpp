@@ -0,0 +1,709 @@
+#include "engine.h"
+#include <algorithm>
+#include <cmath>
+
+//--------------------------------------------------------------
+// Harmonics above the Nyquist frequency of the rendering rate would alias
+// whatever the oversampling factor, so they are not synthesized at all.
+int SynthEngine::harmonicsBelowNyquist(float frequency, float rate){
+	// under load the governor lowers the brillance of the upper voices
+	// the modulation matrix moves the brillance by octaves
+	int brillance = (brillanceOffset == 0.f) ? mBrillance : std::max(1, (int) lroundf(mBrillance * exp2f(brillanceOffset)));
+	int numHarmonics = std::min(governor.brillance(frequency, brillance), maxHarmonics);
+	if (frequency <= 0.f){
+		return numHarmonics;
+	}
+	return std::min(numHarmonics, (int) (0.5f * rate / frequency));
+}
+
+//--------------------------------------------------------------
+void SynthEngine::addSignal(s_signal& signal, const std::vector<float>& multipliers, const std::vector<float>& amplitudes, int numHarmonics,
+	float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo){
+	float pan = 0.5f;
+	float leftScale = 1 - pan;
+	float rightScale = pan;
+
+    float& phase = signal.phase;
+    float volume = signal.volume;
+    float freq = signal.frequency;
+    float nyquist = 0.5f * rate;	// with the modulated pitch, a phase step beyond pi would only alias
+	float ratioStep = (ratioTo - ratioFrom) / numFrames;
+
+	// sin (n) seems to have trouble when n is very large, so we
+	// keep phase in the range of 0-TWO_PI like this (in one step, a
+	// subtraction at a time would never end once phase dwarfs TWO_PI):
+
+    for (size_t i = 0; i < numFrames; i++){
+		if (phase > 2.0 * M_PI){
+			phase -= 2.f * float(M_PI) * floorf(phase / (2.f * float(M_PI)));
+		}
+		oscillatorPhases[i] = phase;
+        phase += 2.0 * M_PI * std::min(freq * (ratioFrom + ratioStep * i), nyquist) / rate; // 2Pi * freq * dt;
+    }
+
+	// the harmonics are summed and mixed by the kernels picked for this CPU
+	const s_dsp_kernels& kernels = dspKernels();
+	kernels.additive(oscillatorPhases.data(), numFrames, multipliers.data(), amplitudes.data(), numHarmonics, oscillatorSamples.data());
+	kernels.mixStereo(oscillatorSamples.data(), volume * leftScale, volume * rightScale, left, right, numFrames);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::renderSignal(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo){
+	// change signal calculation according to 'mWaveShape', Sin by default
+	switch (mWaveShape){
+		case WaveShape::Sin:
+			addSignal_sin(signal, left, right, numFrames, rate, ratioFrom, ratioTo);
+			break;
+		case WaveShape::Saw:
+			addSignal_saw(signal, left, right, numFrames, rate, ratioFrom, ratioTo);
+			break;
+		case WaveShape::Square:
+			addSignal_square(signal, left, right, numFrames, rate, ratioFrom, ratioTo);
+			break;
+		default:
+			addSignal_sin(signal, left, right, numFrames, rate, ratioFrom, ratioTo);
+			break;
+	}
+}
+
+//--------------------------------------------------------------
+// The voices rendered when the governor only keeps the loudest ones: the
+// maxVoices() loudest sounding voices, the first ones in index order among
+// equal volumes (every keyboard and OSC note has the same one). Silent
+// voices cost as much as the others, so they are the first ones stolen.
+void SynthEngine::selectKeptVoices(){
+	int kept = std::min(governor.maxVoices(), maxKeptVoices);
+	keepAllVoices = (kept <= 0);
+	numKeptVoices = 0;
+	if (keepAllVoices){
+		return;
+	}
+	const size_t numVoices = signals.size() + numNotes;
+	auto loudness = [this](size_t voice){
+		return fabsf(voice < signals.size() ? signals[voice].volume : signalsNotes[voice - signals.size()].volume);
+	};
+	while (numKeptVoices < kept){
+		size_t loudest = numVoices;
+		for (size_t voice = 0; voice < numVoices; voice++){
+			if (loudness(voice) > 0.f && !voiceKept(voice) && (loudest == numVoices || loudness(voice) > loudness(loudest))){
+				loudest = voice;
+			}
+		}
+		if (loudest == numVoices){
+			break;
+		}
+		keptVoices[numKeptVoices++] = loudest;
+	}
+}
+
+//--------------------------------------------------------------
+bool SynthEngine::voiceKept(size_t voice) const {
+	if (keepAllVoices){
+		return true;
+	}
+	for (int k = 0; k < numKeptVoices; k++){
+		if (keptVoices[k] == voice){
+			return true;
+		}
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+void SynthEngine::addSignal_sin(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo){
+	int numHarmonics = harmonicsBelowNyquist(signal.frequency * std::max(ratioFrom, ratioTo), rate);
+	addSignal(signal, sinMultipliers, sinAmplitudes, numHarmonics, left, right, numFrames, rate, ratioFrom, ratioTo);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::addSignal_saw(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo){
+	int numHarmonics = harmonicsBelowNyquist(signal.frequency * std::max(ratioFrom, ratioTo), rate);
+	addSignal(signal, sawMultipliers, sawAmplitudes, numHarmonics, left, right, numFrames, rate, ratioFrom, ratioTo);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::addSignal_square(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo){
+	// odd harmonics only
+	int numHarmonics = (harmonicsBelowNyquist(signal.frequency * std::max(ratioFrom, ratioTo), rate) + 1) / 2;
+	addSignal(signal, squareMultipliers, squareAmplitudes, numHarmonics, left, right, numFrames, rate, ratioFrom, ratioTo);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::initHarmonics(){
+	sinMultipliers.assign(maxHarmonics, 0.0);
+	sinAmplitudes.assign(maxHarmonics, 0.0);
+	sawMultipliers.assign(maxHarmonics, 0.0);
+	sawAmplitudes.assign(maxHarmonics, 0.0);
+	squareMultipliers.assign(maxHarmonics, 0.0);
+	squareAmplitudes.assign(maxHarmonics, 0.0);
+	float sign = 1.;
+	for (int k = 0; k < maxHarmonics; k++){
+		sinMultipliers[k] = k + 1;
+		sinAmplitudes[k] = 1.;
+		sawMultipliers[k] = k + 1;
+		sawAmplitudes[k] = sign / (k + 1);
+		squareMultipliers[k] = 2 * k + 1;
+		squareAmplitudes[k] = 1. / (2 * k + 1);
+		sign = -sign;
+	}
+}
+
+void SynthEngine::initSignal(size_t numFrames){
+	for (size_t i = 0; i < numFrames; i++){
+		lAudio[i] = 0.;
+		rAudio[i] = 0.;
+    }
+}
+
+void SynthEngine::initSignalOversampled(size_t numFrames){
+	for (size_t i = 0; i < numFrames; i++){
+		lAudioOversampled[i] = 0.;
+		rAudioOversampled[i] = 0.;
+    }
+}
+
+void SynthEngine::synthesizeSquaredSignal(float frequency, int brillance){
+	for(int k=0; k<brillance; k++){
+		s_signal signal(0., (float(2*k+1)*frequency), volume /((float)(2*k+1)));
+		signals.push_back(signal);
+	}
+}
+
+void SynthEngine::synthesizeSawToothSignal(float frequency, int brillance){
+	float sign = 1.;
+	for(int k=0; k<brillance; k++){
+		s_signal signal(0., (float(k+1)*frequency), sign * volume /((float)(k+1)));
+		signals.push_back(signal);
+		sign = -sign;
+	}
+}
+
+s_filter SynthEngine::lowPassFilter(float frequency, float Q){
+	return designLowPass(frequency, Q, sampleRate);
+}
+
+//--------------------------------------------------------------
+s_filter SynthEngine::highPassFilter(float frequency, float Q){
+	return designHighPass(frequency, Q, sampleRate);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::applyFilter(s_filter filter, float* left, float* right, size_t numFrames){
+	const s_dsp_kernels& kernels = dspKernels();
+	float lState[4] = {lAudioPreviousValues.x_1, lAudioPreviousValues.x_2, lAudioPreviousValues.y_1, lAudioPreviousValues.y_2};
+	float rState[4] = {rAudioPreviousValues.x_1, rAudioPreviousValues.x_2, rAudioPreviousValues.y_1, rAudioPreviousValues.y_2};
+	kernels.biquad(lAudio.data(), left, numFrames,
+		filter.b_0, filter.b_1, filter.b_2, filter.a_1, filter.a_2, lState);
+	kernels.biquad(rAudio.data(), right, numFrames,
+		filter.b_0, filter.b_1, filter.b_2, filter.a_1, filter.a_2, rState);
+	lAudioPreviousValues = s_previous_values(lState[0], lState[1], lState[2], lState[3]);
+	rAudioPreviousValues = s_previous_values(rState[0], rState[1], rState[2], rState[3]);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::setup(size_t frames, size_t rate){
+	bufferSize = frames;
+	sampleRate = rate;
+
+	volume				= 0.1f;
+	octaveIndex			= 4;
+	mBrillance			= 1;
+	mWaveShape			= WaveShape::Sin;
+	for (auto& signal : signalsNotes){
+		signal = s_signal(0.f, 0.f, 0.f);
+	}
+
+	lAudio.assign(bufferSize, 0.0);
+	rAudio.assign(bufferSize, 0.0);
+
+	// Filtering
+	lAudioPreviousValues = s_previous_values(0.f,0.f,0.f,0.f);
+	rAudioPreviousValues = s_previous_values(0.f,0.f,0.f,0.f);
+	lowFrequency = 500;
+	highFrequency = 10000;
+	lowQ = 0.1;
+	highQ = 0.1;
+	lowFilter = lowPassFilter(lowFrequency, lowQ);
+	highFilter = highPassFilter(highFrequency, highQ);
+
+	// Oscillators : harmonic tables and per block scratch buffers
+	initHarmonics();
+	oscillatorPhases.assign(bufferSize * Oversampler::maxFactor, 0.0);
+	oscillatorSamples.assign(bufferSize * Oversampler::maxFactor, 0.0);
+
+	// Oversampling
+	oversamplingFactor = 1;
+	lAudioOversampled.assign(bufferSize * Oversampler::maxFactor, 0.0);
+	rAudioOversampled.assign(bufferSize * Oversampler::maxFactor, 0.0);
+	lOversampler.setup(bufferSize);
+	rOversampler.setup(bufferSize);
+
+	// Dropouts and quality governor
+	dropouts.setup(bufferSize, sampleRate);
+	governor.setup(bufferSize, sampleRate);
+
+	// Patches : prepared by a thread of their own, applied by the audio thread
+	if (frontEnd){
+		patches.start(sampleRate);
+	}
+
+	// Modulation matrix : no route until a patch or /mod/route sets one
+	modulation.setup(sampleRate);
+	notesSounding = 0;
+	brillanceOffset = 0.f;
+	for (int t = 0; t < numModTargets; t++){
+		modulationPrevious[t] = modulation.target(static_cast<ModTarget>(t));
+	}
+	modulationSchedule.assign((bufferSize / ModulationMatrix::controlBlockSize + 2) * numModTargets, 0.0);
+	modulatedFilterPrevious = lowFilter;
+
+	// Master limiter
+	limiter.setup(sampleRate);
+
+	// Scopes : histories written by the audio thread
+	size_t scopeLength = std::max(scopeHistoryLength, bufferSize);
+	lScope.setup(scopeLength);
+	rScope.setup(scopeLength);
+	lFilteredScope.setup(scopeLength);
+	rFilteredScope.setup(scopeLength);
+
+	// Tuner : one sliding DFT bin per pitch of the displayed octaves
+	std::vector<float> tunerTargets;
+	for (int pitch = tunerFirstOctave * 12; pitch < (tunerFirstOctave + tunerNumOctaves) * 12; pitch++){
+		tunerTargets.push_back(pitchToFrequency(pitch));
+	}
+	tuner.setup(sampleRate, tunerFirstOctave, tunerTargets);
+
+	// Spectrogram : fed here, analysed by a thread of its own
+	spectrogram.setup(sampleRate, spectrogramSettings);
+
+	// Granular voice
+	granular.setup(sampleRate);
+	granularEnabled = false;
+}
+
+//--------------------------------------------------------------
+void SynthEngine::close(){
+	patches.stop();
+	spectrogram.stop();
+	tap.close();
+}
+
+//--------------------------------------------------------------
+float pitchToFrequency(int pitch, float A4frequency, int A4pitch){
+	pitch = std::clamp(pitch, 0, maxPitch);
+	return A4frequency * pow(2, ((pitch - A4pitch) / 12.f));
+}
+
+//--------------------------------------------------------------
+// Entry point of every audio backend. outputs are planar: 0 and 1 get the
+// master, 2 and 3 the dry signal before the filter. Blocks longer than the
+// buffers allocated in setup() are rendered in several chunks.
+void SynthEngine::renderBlock(float* const* outputs, int numOutputs, size_t numFrames){
+	beginBlock();
+	renderFrames(outputs, numOutputs, numFrames);
+	endBlock(numFrames);
+}
+
+//--------------------------------------------------------------
+// Once per callback of the backend, even when the callback is rendered by
+// several renderFrames(), so that the governor sees the load of the
+// callback against its own deadline.
+void SynthEngine::beginBlock(){
+	dropouts.blockStarted();
+	if (!audioThreadKnown.load(std::memory_order_relaxed)){
+		if (prefaultStack){
+			::prefaultStack(64 * 1024);
+		}
+		audioThread = currentThread();
+		audioThreadKnown.store(true, std::memory_order_release);
+	}
+
+	// commands received since the previous block take effect now, then
+	// the patch the loader thread may have prepared meanwhile
+	applyCommands();
+	if (const s_prepared_patch* prepared = patches.take()){
+		applyPatch(*prepared);
+		patches.retire(prepared);
+	}
+
+	// decide the quality of this block from the load of the previous one
+	governor.update(governed.load(std::memory_order_relaxed) ? dropouts.load() : 0.f);
+	granular.densityScale = governor.grainDensityScale();
+}
+
+//--------------------------------------------------------------
+void SynthEngine::endBlock(size_t numFrames){
+	dropouts.blockFinished(numFrames);
+}
+
+//--------------------------------------------------------------
+// The frames of a callback, or a part of them: notes changed between two
+// calls are gated from the first frame of the second one.
+void SynthEngine::renderFrames(float* const* outputs, int numOutputs, size_t numFrames){
+	gateModulation();
+
+	for (size_t offset = 0; offset < numFrames; offset += bufferSize){
+		size_t chunk = std::min(bufferSize, numFrames - offset);
+		float* left = outputs[0] + offset;
+		float* right = outputs[1] + offset;
+		renderChunk(left, right, chunk);
+		if (numOutputs >= 4){
+			std::copy(lAudio.begin(), lAudio.begin() + chunk, outputs[2] + offset);
+			std::copy(rAudio.begin(), rAudio.begin() + chunk, outputs[3] + offset);
+		}
+	}
+	// readers that fall behind lose blocks, the tap never waits for them
+	tap.publish(outputs, numFrames);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::renderChunk(float* outLeft, float* outRight, size_t numFrames){
+	// the oscillators are rendered at factor * sampleRate, then decimated
+	// back to sampleRate by the half-band cascade
+	int factor = governor.oversamplingAllowed() ? oversamplingFactor : 1;
+	size_t numFramesOversampled = numFrames * factor;
+	float rate = (float) sampleRate * factor;
+	float* left = (factor > 1) ? lAudioOversampled.data() : lAudio.data();
+	float* right = (factor > 1) ? rAudioOversampled.data() : rAudio.data();
+	initSignal(numFrames);
+	if (factor > 1){
+		initSignalOversampled(numFramesOversampled);
+	}
+	
+	// the matrix moves one control block at a time, its targets are
+	// ramped in between
+	size_t numBlocks = scheduleModulation(numFrames);
+	bool modulated = modulation.isActive();
+
+	// a stolen voice is simply not rendered, it keeps its volume and is
+	// heard again as soon as the governor gives the quality back
+	selectKeptVoices();
+	if (modulated){
+		renderModulatedSignals(left, right, numFrames, factor, rate, numBlocks);
+	} else {
+		for (size_t voice = 0; voice < signals.size(); voice++){
+			if (voiceKept(voice)){
+				renderSignal(signals[voice], left, right, numFramesOversampled, rate);
+			}
+		}
+		for (int note = 0; note < numNotes; note++){
+			if (voiceKept(signals.size() + note)){
+				renderSignal(signalsNotes[note], left, right, numFramesOversampled, rate);
+			}
+		}
+	}
+	// nonlinear stages belong here, before decimation
+	lOversampler.process(left, lAudio.data(), numFrames, factor);
+	rOversampler.process(right, rAudio.data(), numFrames, factor);
+
+	// the granular voice replaces the oscillators output by grains read
+	// from it, or from the sample dropped on the window
+	if (granularEnabled){
+		granular.writeSource(lAudio.data(), rAudio.data(), numFrames);
+		initSignal(numFrames);
+		granular.gain = granular.isLive() ? 1.f : volume;
+		granular.process(lAudio.data(), rAudio.data(), numFrames);
+	}
+	if (modulated){
+		applyModulatedGain(numFrames, numBlocks);
+	}
+	if (frontEnd){
+		tuner.process(lAudio.data(), rAudio.data(), numFrames);
+	}
+
+	// the filter writes straight into the backend buffers
+	if (modulated){
+		applyModulatedFilter(outLeft, outRight, numFrames, numBlocks);
+	} else {
+		applyFilter(lowFilter, outLeft, outRight, numFrames);
+		modulatedFilterPrevious = lowFilter;
+	}
+
+	// last stage : nothing above the ceiling reaches the sound card
+	limiter.process(outLeft, outRight, numFrames);
+
+	// the filtered right channel goes last, its generation tells draw()
+	// that a whole block is available
+	if (frontEnd){
+		lScope.write(lAudio.data(), numFrames);
+		rScope.write(rAudio.data(), numFrames);
+		lFilteredScope.write(outLeft, numFrames);
+		rFilteredScope.write(outRight, numFrames);
+		spectrogram.write(outLeft, outRight, numFrames);
+	}
+}
+
+//--------------------------------------------------------------
+// Envelopes restart at every new note and release once no note is left:
+// the modulators are shared by all the voices.
+void SynthEngine::gateModulation(){
+	int sounding = 0;
+	for (auto& signal : signalsNotes){
+		if (signal.volume > 0.f){
+			sounding++;
+		}
+	}
+	if (sounding > notesSounding){
+		modulation.gate(true, true);
+	} else if (sounding == 0 && notesSounding > 0){
+		modulation.gate(false, false);
+	}
+	notesSounding = sounding;
+}
+
+//--------------------------------------------------------------
+// Runs the matrix over the chunk, one control block at a time. Row 0 of the
+// schedule holds the targets where the previous chunk ended, row b + 1
+// those at the end of control block b. Returns the number of blocks.
+size_t SynthEngine::scheduleModulation(size_t numFrames){
+	const size_t block = ModulationMatrix::controlBlockSize;
+	size_t numBlocks = (numFrames + block - 1) / block;
+	float* row = modulationSchedule.data();
+	std::copy(modulationPrevious, modulationPrevious + numModTargets, row);
+	for (size_t b = 0; b < numBlocks; b++){
+		modulation.advance(std::min(block, numFrames - b * block));
+		row += numModTargets;
+		for (int t = 0; t < numModTargets; t++){
+			row[t] = modulation.target(static_cast<ModTarget>(t));
+		}
+	}
+	std::copy(row, row + numModTargets, modulationPrevious);
+	return numBlocks;
+}
+
+//--------------------------------------------------------------
+// The oscillators one control block at a time, so that their pitch follows
+// the ramps. The brillance takes the value of the end of each block.
+void SynthEngine::renderModulatedSignals(float* left, float* right, size_t numFrames, int factor, float rate, size_t numBlocks){
+	const size_t block = ModulationMatrix::controlBlockSize;
+	const int pitch = static_cast<int>(ModTarget::Pitch);
+	const int brillance = static_cast<int>(ModTarget::Brillance);
+	for (size_t b = 0; b < numBlocks; b++){
+		const float* from = &modulationSchedule[b * numModTargets];
+		const float* to = from + numModTargets;
+		size_t offset = b * block * factor;
+		size_t frames = std::min(block, numFrames - b * block) * factor;
+		float ratioFrom = exp2f(from[pitch] / 12.f);
+		float ratioTo = exp2f(to[pitch] / 12.f);
+		brillanceOffset = to[brillance];
+		for (size_t voice = 0; voice < signals.size(); voice++){
+			if (voiceKept(voice)){
+				renderSignal(signals[voice], left + offset, right + offset, frames, rate, ratioFrom, ratioTo);
+			}
+		}
+		for (int note = 0; note < numNotes; note++){
+			if (voiceKept(signals.size() + note)){
+				renderSignal(signalsNotes[note], left + offset, right + offset, frames, rate, ratioFrom, ratioTo);
+			}
+		}
+	}
+	brillanceOffset = 0.f;
+}
+
+//--------------------------------------------------------------
+// equal power, unity gain at the centre
+static void panGains(float gain, float pan, float& left, float& right){
+	float angle = 0.25f * M_PI * (1.f + std::clamp(pan, -1.f, 1.f));
+	left = gain * M_SQRT2 * cosf(angle);
+	right = gain * M_SQRT2 * sinf(angle);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::applyModulatedGain(size_t numFrames, size_t numBlocks){
+	const size_t block = ModulationMatrix::controlBlockSize;
+	const int gain = static_cast<int>(ModTarget::Volume);
+	const int pan = static_cast<int>(ModTarget::Pan);
+	for (size_t b = 0; b < numBlocks; b++){
+		const float* from = &modulationSchedule[b * numModTargets];
+		const float* to = from + numModTargets;
+		size_t offset = b * block;
+		size_t frames = std::min(block, numFrames - offset);
+		float leftFrom, rightFrom, leftTo, rightTo;
+		panGains(from[gain], from[pan], leftFrom, rightFrom);
+		panGains(to[gain], to[pan], leftTo, rightTo);
+		float leftStep = (leftTo - leftFrom) / frames;
+		float rightStep = (rightTo - rightFrom) / frames;
+		for (size_t i = 0; i < frames; i++){
+			lAudio[offset + i] *= leftFrom + leftStep * (i + 1);
+			rAudio[offset + i] *= rightFrom + rightStep * (i + 1);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+// Same as applyFilter, with coefficients designed at the end of every
+// control block and interpolated in between.
+void SynthEngine::applyModulatedFilter(float* left, float* right, size_t numFrames, size_t numBlocks){
+	const size_t block = ModulationMatrix::controlBlockSize;
+	const int cutoff = static_cast<int>(ModTarget::FilterCutoff);
+	const int q = static_cast<int>(ModTarget::FilterQ);
+	const s_dsp_kernels& kernels = dspKernels();
+	float lState[4] = {lAudioPreviousValues.x_1, lAudioPreviousValues.x_2, lAudioPreviousValues.y_1, lAudioPreviousValues.y_2};
+	float rState[4] = {rAudioPreviousValues.x_1, rAudioPreviousValues.x_2, rAudioPreviousValues.y_1, rAudioPreviousValues.y_2};
+	const s_filter& previous = modulatedFilterPrevious;
+	float from[5] = {previous.b_0, previous.b_1, previous.b_2, previous.a_1, previous.a_2};
+	for (size_t b = 0; b < numBlocks; b++){
+		const float* target = &modulationSchedule[(b + 1) * numModTargets];
+		size_t offset = b * block;
+		size_t frames = std::min(block, numFrames - offset);
+		float frequency = std::clamp(lowFrequency * exp2f(target[cutoff]), 10.f, 0.49f * sampleRate);
+		float Q = std::max(lowQ * exp2f(target[q]), 0.01f);
+		s_filter filter = lowPassFilter(frequency, Q);
+		float to[5] = {filter.b_0, filter.b_1, filter.b_2, filter.a_1, filter.a_2};
+		kernels.biquadRamp(lAudio.data() + offset, left + offset, frames, from, to, lState);
+		kernels.biquadRamp(rAudio.data() + offset, right + offset, frames, from, to, rState);
+		std::copy(to, to + 5, from);
+	}
+	modulatedFilterPrevious = s_filter(from[0], from[1], from[2], from[3], from[4]);
+	lAudioPreviousValues = s_previous_values(lState[0], lState[1], lState[2], lState[3]);
+	rAudioPreviousValues = s_previous_values(rState[0], rState[1], rState[2], rState[3]);
+}
+
+//--------------------------------------------------------------
+void SynthEngine::applyCommands(){
+	// bounded by the queue size, and by what arrived during one block
+	s_synth_command command;
+	int64_t worst = 0;
+	int64_t now = 0;
+	while (commands != nullptr && commands->pop(command)){
+		if (now == 0){
+			now = monotonicNs();
+		}
+		worst = std::max(worst, now - command.receivedNs);
+		applyCommand(command);
+	}
+	if (worst > commandLatencyNs.load(std::memory_order_relaxed)){
+		commandLatencyNs.store(worst, std::memory_order_relaxed);
+	}
+}
+
+//--------------------------------------------------------------
+// The same effects as the keyboard and the mouse, see keyPressed and mouseMoved.
+void SynthEngine::applyCommand(const s_synth_command& command){
+	int note = ((command.intValue % numNotes) + numNotes) % numNotes;
+	switch (command.type){
+		case SynthCommandType::NoteOn:
+			signalsNotes[note].frequency = pitchToFrequency(command.intValue);
+			signalsNotes[note].volume = (command.value >= 0.f) ? std::min(command.value, 1.f) : volume;
+			break;
+		case SynthCommandType::NoteOff:
+			signalsNotes[note].volume = 0.0;
+			break;
+		case SynthCommandType::Brillance:
+			mBrillance = std::max(command.intValue, 1);
+			break;
+		case SynthCommandType::Octave:
+			octaveIndex = std::clamp(command.intValue, minOctave, maxOctave);
+			break;
+		case SynthCommandType::Volume:
+			volume = std::clamp(command.value, 0.f, 1.f);
+			break;
+		case SynthCommandType::FilterCutoff:
+			lowFrequency = std::clamp(command.value, 10.f, 0.49f * sampleRate);
+			lowFilter = lowPassFilter(lowFrequency, lowQ);
+			break;
+		case SynthCommandType::FilterQ:
+			lowQ = std::max(command.value, 0.01f);
+			lowFilter = lowPassFilter(lowFrequency, lowQ);
+			break;
+		case SynthCommandType::WaveShape:
+			// same order as the WaveShape enum
+			setWaveShape(static_cast<WaveShape>(command.intValue));
+			break;
+		case SynthCommandType::Patch:
+			// prepared by the loader thread, applied at a later block
+			patches.request(command.intValue);
+			break;
+		case SynthCommandType::ModLfo:
+		case SynthCommandType::ModEnvelope:
+		case SynthCommandType::ModRoute:{
+			// slots, shapes, targets and route sources were checked by the parser
+			s_modulation_settings settings = modulation.settings();
+			if (command.type == SynthCommandType::ModLfo){
+				s_modulator_settings& modulator = settings.modulators[command.intValue];
+				modulator.shape = static_cast<ModShape>(int(command.arguments[0]));
+				modulator.rate = std::max(command.arguments[1], 0.f);
+			} else if (command.type == SynthCommandType::ModEnvelope){
+				s_modulator_settings& modulator = settings.modulators[command.intValue];
+				modulator.shape = ModShape::Envelope;
+				modulator.attack = std::max(command.arguments[0], 0.f);
+				modulator.decay = std::max(command.arguments[1], 0.f);
+				modulator.sustain = std::clamp(command.arguments[2], 0.f, 1.f);
+				modulator.release = std::max(command.arguments[3], 0.f);
+			} else {
+				s_mod_route& route = settings.routes[command.intValue];
+				route.source = int(command.arguments[0]);
+				route.target = static_cast<ModTarget>(int(command.arguments[1]));
+				route.depth = command.arguments[2];
+			}
+			modulation.configure(settings);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+//--------------------------------------------------------------
+void SynthEngine::setWaveShape(WaveShape shape){
+	mWaveShape = shape;
+}
+
+//--------------------------------------------------------------
+// Audio thread, between two blocks. Only copies: the coefficients were
+// computed by the loader thread. The notes already sounding keep their
+// volume and their phase.
+void SynthEngine::applyPatch(const s_prepared_patch& prepared){
+	const s_patch& patch = prepared.patch;
+	setWaveShape(static_cast<WaveShape>(std::min(std::max(patch.waveShape, 0), 2)));
+	mBrillance = std::max(patch.brillance, 1);
+	octaveIndex = patch.octaveIndex;
+	volume = std::clamp(patch.volume, 0.f, 1.f);
+	lowFrequency = patch.lowFrequency;
+	lowQ = patch.lowQ;
+	lowFilter = prepared.lowFilter;
+	highFrequency = patch.highFrequency;
+	highQ = patch.highQ;
+	highFilter = prepared.highFilter;
+	oversamplingFactor = 1;
+	while (oversamplingFactor < patch.oversamplingFactor && oversamplingFactor < Oversampler::maxFactor){
+		oversamplingFactor *= 2;
+	}
+	granularEnabled = patch.granularEnabled;
+	granular.density = patch.grainDensity;
+	granular.grainSize = patch.grainSize;
+	granular.pitchJitter = patch.grainPitchJitter;
+	limiter.truePeak = patch.limiterTruePeak;
+	modulation.configure(patch.modulation);
+}
+
+//--------------------------------------------------------------
+s_patch SynthEngine::currentPatch(){
+	s_patch patch = defaultPatch();
+	snprintf(patch.name, sizeof(patch.name), "%s %d", mWaveShape == WaveShape::Saw ? "saw" : mWaveShape == WaveShape::Square ? "square" : "sine", mBrillance);
+	patch.waveShape = static_cast<int>(mWaveShape);
+	patch.brillance = mBrillance;
+	patch.octaveIndex = octaveIndex;
+	patch.volume = volume;
+	patch.lowFrequency = lowFrequency;
+	patch.lowQ = lowQ;
+	patch.highFrequency = highFrequency;
+	patch.highQ = highQ;
+	patch.oversamplingFactor = oversamplingFactor;
+	patch.granularEnabled = granularEnabled;
+	patch.grainDensity = granular.density;
+	patch.grainSize = granular.grainSize;
+	patch.grainPitchJitter = granular.pitchJitter;
+	patch.limiterTruePeak = limiter.truePeak;
+	patch.modulation = modulation.settings();
+	return patch;
+}
+
+//--------------------------------------------------------------
+void SynthEngine::blockSizeChanged(size_t numFrames){
+	// the buffers keep their size, only the deadline moves
+	dropouts.setup(numFrames, sampleRate);
+	governor.setup(numFrames, sampleRate);
+}
+
@@ -0,0 +1,219 @@
+#pragma once
+#include "dsp_kernels.h"
+#include "filter_design.h"
+#include "governor.h"
+#include "granular.h"
+#include "jack_backend.h"
+#include "limiter.h"
+#include "modulation.h"
+#include "osc_server.h"
+#include "oversampler.h"
+#include "patch.h"
+#include "realtime.h"
+#include "scope.h"
+#include "shared_tap.h"
+#include "spectrogram.h"
+#include "tuner.h"
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef struct{
+	float phase;
+	float frequency;
+	float volume;
+} s_signal;
+
+typedef struct{
+	float x_1;
+	float x_2;
+	float y_1;
+	float y_2;
+} s_previous_values;
+
+enum class Notes
+{
+	C,
+	Db,
+	D,
+	Eb,
+	E,
+	F,
+	Gb,
+	G,
+	Ab,
+	A,
+	Bb,
+	B,
+	sizeNotes,
+	No_sound,
+};
+
+enum class WaveShape
+{
+	Sin,
+	Square,
+	Saw,
+};
+
+// The playable range, C0 to B9: the keyboard octaves and the /note/on
+// pitches. pitchToFrequency() clamps the pitch to it.
+static constexpr int minOctave = 0;
+static constexpr int maxOctave = 9;
+static constexpr int maxPitch = (maxOctave + 1) * 12 - 1;
+
+float pitchToFrequency(int pitch, float A4frequency = 440.f, int A4pitch = 57);
+
+// The sound engine: oscillators, notes, filters, granular voice, modulation,
+// limiter, and the scopes and tuner fed by the audio thread. It does not
+// depend on openFrameworks, so that tools, benchmarks and plugins can link
+// it alone (the synthcore library of CMakeLists.txt); ofApp is a front-end
+// over it.
+//
+// Every audio backend calls renderBlock(). The settings are plain members,
+// changed by the front-end between two blocks as the keyboard always did;
+// commands and patches take the wait free paths of applyCommands() and of
+// the patch loader.
+class SynthEngine : public AudioRenderer{
+
+	public:
+
+		// every buffer is allocated here, for blocks of up to bufferSize
+		// frames, and the patch loader thread is started
+		void setup(size_t bufferSize, size_t sampleRate);
+		bool frontEnd = true;	// false: no patch loader, scopes, tuner nor spectrogram, for hosts without our GUI; taken by setup()
+		void close();
+
+		void renderBlock(float* const* outputs, int numOutputs, size_t numFrames) override;
+		void blockSizeChanged(size_t numFrames) override;
+
+		// renderBlock() in parts, for the hosts that split a callback at
+		// their events: beginBlock(), renderFrames() for every part, then
+		// endBlock() with the frames of the whole callback
+		void beginBlock();
+		void renderFrames(float* const* outputs, int numOutputs, size_t numFrames);
+		void endBlock(size_t numFrames);
+		void renderChunk(float* outLeft, float* outRight, size_t numFrames);
+
+		// audio thread, or any thread while no block is rendered
+		void applyCommand(const s_synth_command& command);
+		void applyPatch(const s_prepared_patch& prepared);
+		void setWaveShape(WaveShape shape);
+		s_patch currentPatch();
+		s_filter lowPassFilter(float frequency, float Q);
+		s_filter highPassFilter(float frequency, float Q);
+
+		size_t bufferSize = 0;
+		size_t sampleRate = 44100;
+
+		float 	volume;
+		int 	octaveIndex;
+		int 	mBrillance;
+		WaveShape mWaveShape;
+		static constexpr int numNotes = static_cast<int>(Notes::sizeNotes);
+		s_signal signalsNotes[numNotes];
+		std::vector<s_signal> signals;
+
+		// dry signal of the last chunk, before the filter
+		std::vector<float> lAudio;
+		std::vector<float> rAudio;
+
+		//------------------- oscillators
+		void renderSignal(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom = 1.f, float ratioTo = 1.f);
+		void addSignal_sin(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo);
+		void addSignal_saw(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo);
+		void addSignal_square(s_signal& signal, float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo);
+		void addSignal(s_signal& signal, const std::vector<float>& multipliers, const std::vector<float>& amplitudes, int numHarmonics,
+			float* left, float* right, size_t numFrames, float rate, float ratioFrom, float ratioTo);
+		int harmonicsBelowNyquist(float frequency, float rate);
+		void initHarmonics();
+		static constexpr int maxHarmonics = 1024;
+		std::vector<float> sinMultipliers, sinAmplitudes;
+		std::vector<float> sawMultipliers, sawAmplitudes;
+		std::vector<float> squareMultipliers, squareAmplitudes;
+		std::vector<float> oscillatorPhases;
+		std::vector<float> oscillatorSamples;
+		void initSignal(size_t numFrames);
+		void initSignalOversampled(size_t numFrames);
+		void synthesizeSquaredSignal(float frequency, int brillance);
+		void synthesizeSawToothSignal(float frequency, int brillance);
+
+		//------------------- filters
+		float lowFrequency;
+		float highFrequency;
+		float lowQ;
+		float highQ;
+		s_filter lowFilter;
+		s_filter highFilter;
+		s_previous_values lAudioPreviousValues;
+		s_previous_values rAudioPreviousValues;
+		void applyFilter(s_filter filter, float* left, float* right, size_t numFrames);
+
+		//------------------- oversampling
+		int oversamplingFactor;	// 1, 2, 4 or 8, per patch
+		std::vector<float> lAudioOversampled;
+		std::vector<float> rAudioOversampled;
+		Oversampler lOversampler;
+		Oversampler rOversampler;
+
+		//------------------- audio thread and dropouts
+		bool prefaultStack = false;		// touch the stack pages at the first block, realtime mode
+		s_thread_handle audioThread;
+		std::atomic<bool> audioThreadKnown{false};
+		DropoutCounter dropouts;
+
+		//------------------- quality governor
+		QualityGovernor governor;
+		std::atomic<bool> governed{true};	// false: full quality whatever the load, for offline rendering; any thread
+		static constexpr int maxKeptVoices = 16;
+		bool keepAllVoices = true;
+		int numKeptVoices = 0;
+		size_t keptVoices[maxKeptVoices];	// signals first, then signalsNotes
+		void selectKeptVoices();
+		bool voiceKept(size_t voice) const;
+
+		//------------------- commands, see osc_server.h
+		OscServer::CommandQueue* commands = nullptr;	// drained at the start of every block
+		std::atomic<int64_t> commandLatencyNs{0};		// worst since the last exchange, receive to block start
+		void applyCommands();
+
+		//------------------- modulation matrix, see modulation.h
+		static constexpr int numModTargets = static_cast<int>(ModTarget::sizeTargets);
+		ModulationMatrix modulation;
+		int notesSounding;						// audio thread, gates the envelopes
+		float brillanceOffset;					// octaves, set per control block
+		float modulationPrevious[numModTargets];// targets at the end of the previous chunk
+		std::vector<float> modulationSchedule;	// targets at the start, then at the end of every control block of a chunk
+		s_filter modulatedFilterPrevious;
+		void gateModulation();
+		size_t scheduleModulation(size_t numFrames);
+		void renderModulatedSignals(float* left, float* right, size_t numFrames, int factor, float rate, size_t numBlocks);
+		void applyModulatedGain(size_t numFrames, size_t numBlocks);
+		void applyModulatedFilter(float* left, float* right, size_t numFrames, size_t numBlocks);
+
+		//------------------- patches
+		PatchLoader patches;
+
+		//------------------- shared memory tap
+		SharedTapWriter tap;
+
+		//------------------- master limiter
+		LookaheadLimiter limiter;
+
+		//------------------- analysis, read by the front-end
+		static constexpr size_t scopeHistoryLength = 2048;
+		ScopeHistory lScope;
+		ScopeHistory rScope;
+		ScopeHistory lFilteredScope;
+		ScopeHistory rFilteredScope;
+		NoteTuner tuner;
+		static constexpr int tunerFirstOctave = 1;
+		static constexpr int tunerNumOctaves = 7;
+		s_spectrogram_settings spectrogramSettings;	// taken by setup()
+		Spectrogram spectrogram;					// of the master, its thread is started by the front-end
+
+		//------------------- granular voice
+		GranularVoice granular;
+		bool granularEnabled;
+};
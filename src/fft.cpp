@@ -0,0 +1,44 @@
+#include "fft.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <utility>
+
+//--------------------------------------------------------------
+void Fft::setup(size_t size){
+	mSize = size;
+	int bits = 0;
+	while ((size_t(1) << bits) < size){
+		bits++;
+	}
+	mBitReverse.assign(size, 0);
+	for (size_t i = 0; i < size; i++){
+		uint32_t reversed = 0;
+		for (int b = 0; b < bits; b++){
+			reversed |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		mBitReverse[i] = reversed;
+	}
+	// each stage gets its own contiguous twiddles so the butterflies read
+	// them with unit stride
+	mTwiddleRe.assign(size > 1 ? size - 1 : 1, 1.f);
+	mTwiddleIm.assign(size > 1 ? size - 1 : 1, 0.f);
+	for (size_t half = 1; half < size; half *= 2){
+		for (size_t j = 0; j < half; j++){
+			double angle = -M_PI * j / half;
+			mTwiddleRe[half - 1 + j] = cos(angle);
+			mTwiddleIm[half - 1 + j] = sin(angle);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void Fft::forward(float* re, float* im) const {
+	for (size_t i = 0; i < mSize; i++){
+		size_t j = mBitReverse[i];
+		if (j > i){
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+	dspKernels().fft(re, im, mSize, mTwiddleRe.data(), mTwiddleIm.data());
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Radix-2 complex FFT on split real/imaginary arrays. Tables are built by
+// setup(), forward() itself does not allocate and runs the dispatched kernel.
+class Fft{
+
+	public:
+
+		static bool isPowerOfTwo(size_t size) { return size != 0 && (size & (size - 1)) == 0; }
+
+		void setup(size_t size);	// size must be a power of two
+		void forward(float* re, float* im) const;
+		size_t size() const { return mSize; }
+
+	private:
+
+		size_t mSize = 0;
+		std::vector<uint32_t> mBitReverse;
+		std::vector<float> mTwiddleRe;	// stage with half size h starts at h - 1
+		std::vector<float> mTwiddleIm;
+};
+
@@ -0,0 +1,32 @@
+#include "filter_design.h"
+#include <cmath>
+
+//--------------------------------------------------------------
+s_filter designLowPass(float frequency, float Q, float sampleRate){
+	float omega_0 = 2.0 * M_PI * frequency / sampleRate;
+	float cos_omega_0 = cos(omega_0);
+	float alpha = sin(omega_0) / (2.0f * Q);
+	s_filter filter;
+	float a_0 = 1.0+alpha;
+	filter.a_1 = (-2. * cos_omega_0) / a_0;
+	filter.a_2 = (1.0 - alpha) / a_0;
+	filter.b_1 = (1.0 - cos_omega_0) / (a_0);
+	filter.b_0 =  filter.b_1 / 2.0;
+	filter.b_2 = filter.b_0;
+	return filter;
+}
+
+//--------------------------------------------------------------
+s_filter designHighPass(float frequency, float Q, float sampleRate){
+	float omega_0 = 2.0 * M_PI * frequency / sampleRate;
+	float cos_omega_0 = cos(omega_0);
+	float alpha = sin(omega_0) / (2.0f * Q);
+	s_filter filter;
+	float a_0 = 1.0+alpha;
+	filter.a_1 = (-2. * cos_omega_0) / a_0;
+	filter.a_2 = (1.0 - alpha) / a_0;
+	filter.b_1 = -(1.0 + cos_omega_0) / (a_0);
+	filter.b_0 = - filter.b_1 / 2.0;
+	filter.b_2 = filter.b_0;
+	return filter;
+}
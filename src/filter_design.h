@@ -0,0 +1,13 @@
+#pragma once
+
+typedef struct{
+	float b_0;
+	float b_1;
+	float b_2;
+	float a_1;
+	float a_2;
+} s_filter;
+
+// Second order sections of the Audio EQ Cookbook, normalized by a_0.
+s_filter designLowPass(float frequency, float Q, float sampleRate);
+s_filter designHighPass(float frequency, float Q, float sampleRate);
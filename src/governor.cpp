@@ -0,0 +1,76 @@
+#include "governor.h"
+#include <algorithm>
+
+//--------------------------------------------------------------
+void QualityGovernor::setup(size_t bufferSize, size_t sampleRate){
+	float blocksPerSecond = float(sampleRate) / float(std::max<size_t>(bufferSize, 1));
+	mHoldBlocks = std::max(2, int(0.05f * blocksPerSecond));
+	mMinCalmBlocks = std::max(4, int(blocksPerSecond));
+	mMaxCalmBlocks = 16 * mMinCalmBlocks;
+	mCalmBlocks = mMinCalmBlocks;
+	mHold = 0;
+	mCalm = 0;
+	mSinceRestore = mMaxCalmBlocks;
+	mTier.store(0, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::update(float load){
+	int tier = mTier.load(std::memory_order_relaxed);
+	const int lowest = static_cast<int>(QualityTier::sizeTiers) - 1;
+
+	if (load > degradeLoad){
+		mCalm = 0;
+		if (mHold == 0 && tier < lowest){
+			tier++;
+			mHold = mHoldBlocks;
+			// the tier given back last was not affordable after all
+			if (mSinceRestore < mCalmBlocks){
+				mCalmBlocks = std::min(2 * mCalmBlocks, mMaxCalmBlocks);
+			}
+		}
+	} else if (load < restoreLoad){
+		if (tier > 0 && ++mCalm >= mCalmBlocks){
+			tier--;
+			mCalm = 0;
+			mSinceRestore = 0;
+		}
+	} else {
+		mCalm = 0;
+	}
+
+	mHold = std::max(0, mHold - 1);
+	if (mSinceRestore < mMaxCalmBlocks){
+		mSinceRestore++;
+	} else {
+		// stable for long enough, forget the back off
+		mCalmBlocks = mMinCalmBlocks;
+	}
+	mTier.store(tier, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+int QualityGovernor::brillance(float frequency, int brillance) const {
+	if (tier() >= QualityTier::ReducedBrillance && frequency > upperVoiceFrequency){
+		return std::max(1, brillance / 4);
+	}
+	return brillance;
+}
+
+//--------------------------------------------------------------
+const char* QualityGovernor::name(QualityTier tier){
+	switch (tier){
+		case QualityTier::Full:
+			return "full";
+		case QualityTier::ReducedBrillance:
+			return "reduced brillance on upper voices";
+		case QualityTier::FewerGrains:
+			return "fewer grains";
+		case QualityTier::NoOversampling:
+			return "oversampling bypassed";
+		case QualityTier::StealVoices:
+			return "quietest voices stolen";
+		default:
+			return "";
+	}
+}
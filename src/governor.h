@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Quality ladder, from the most expensive rendering to the cheapest. Each
+// tier keeps the savings of the previous ones.
+enum class QualityTier
+{
+	Full,
+	ReducedBrillance,	// fewer harmonics on the upper voices
+	FewerGrains,		// the granular voice sprays half as many grains
+	NoOversampling,		// oscillators rendered at the base rate
+	StealVoices,		// only the loudest voices are rendered
+	sizeTiers,
+};
+
+// Watches the DSP time of each block against the period and steps the
+// quality down as soon as a block gets close to the deadline, before it
+// actually drops out. Quality comes back one tier at a time after a calm
+// period, which doubles each time a restored tier had to be given up again
+// shortly after, so that the governor does not oscillate around a load.
+class QualityGovernor{
+
+	public:
+
+		void setup(size_t bufferSize, size_t sampleRate);
+		void update(float load);	// audio thread, load of the previous block (DSP time / period)
+
+		QualityTier tier() const { return static_cast<QualityTier>(mTier.load(std::memory_order_relaxed)); }
+		static const char* name(QualityTier tier);
+
+		// what the current tier allows, read by audioOut
+		int brillance(float frequency, int brillance) const;
+		float grainDensityScale() const { return tier() >= QualityTier::FewerGrains ? 0.5f : 1.f; }
+		bool oversamplingAllowed() const { return tier() < QualityTier::NoOversampling; }
+		int maxVoices() const { return tier() >= QualityTier::StealVoices ? keptVoices : 0; }	// 0: no limit
+
+		float degradeLoad = 0.75f;		// above: one tier down
+		float restoreLoad = 0.45f;		// below during the calm period: one tier up
+		float upperVoiceFrequency = 880.f;
+		int keptVoices = 4;
+
+	private:
+
+		std::atomic<int> mTier{0};
+		int mHoldBlocks = 1;		// blocks to wait after a step down, so that it shows in the load
+		int mMinCalmBlocks = 1;
+		int mMaxCalmBlocks = 1;
+		int mCalmBlocks = 1;		// current calm period before a step up
+		int mHold = 0;
+		int mCalm = 0;
+		int mSinceRestore = 0;
+};
@@ -0,0 +1,255 @@
+#include "granular.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <algorithm>
+
+//--------------------------------------------------------------
+GrainPool::GrainPool(size_t capacity) : mGrains(capacity), mFreeList(nullptr), mUsed(0){
+	for (auto& grain : mGrains){
+		grain.next = mFreeList;
+		mFreeList = &grain;
+	}
+}
+
+//--------------------------------------------------------------
+s_grain* GrainPool::acquire(){
+	s_grain* grain = mFreeList;
+	if (grain != nullptr){
+		mFreeList = grain->next;
+		grain->next = nullptr;
+		mUsed++;
+	}
+	return grain;
+}
+
+//--------------------------------------------------------------
+void GrainPool::release(s_grain* grain){
+	grain->next = mFreeList;
+	mFreeList = grain;
+	mUsed--;
+}
+
+//--------------------------------------------------------------
+static float clamp01(float x){
+	return std::min(1.f, std::max(0.f, x));
+}
+
+//--------------------------------------------------------------
+GranularVoice::GranularVoice() : mPool(maxGrains), mActive(nullptr), mSource(&mLive), mPending(nullptr), mRetired(nullptr){
+	density 		= 200.f;
+	grainSize 		= 0.05f;
+	pitch 			= 1.f;
+	pitchJitter 	= 0.f;
+	position 		= 0.1f;
+	positionJitter 	= 0.05f;
+	spread 			= 0.5f;
+	gain 			= 1.f;
+	window 			= GrainWindow::Hann;
+	densityScale 	= 1.f;
+	mWriteHead 		= 0;
+	mBlockStart 	= 0;
+	sampleRate 		= 44100;
+	mNextSpawn 		= 0.f;
+	mSeed 			= 0x9E3779B9u;
+
+	mLive.data.assign(liveSourceSize, 0.f);
+	mLive.mask = liveSourceSize - 1;
+	mLive.length = liveSourceSize;
+	mLive.rateRatio = 1.f;
+	mLive.live = true;
+
+	// window tables have one extra point so that a phase rounded up to
+	// windowSize still reads a valid (silent) value
+	for (auto& table : mWindows){
+		table.assign(windowSize + 1, 0.f);
+	}
+	for (size_t i = 0; i < windowSize; i++){
+		float x = float(i) / windowSize;
+		mWindows[static_cast<int>(GrainWindow::Hann)][i] = 0.5f - 0.5f * cos(2.0 * M_PI * x);
+		float g = (x - 0.5f) / 0.15f;
+		mWindows[static_cast<int>(GrainWindow::Gauss)][i] = exp(-0.5f * g * g);
+		mWindows[static_cast<int>(GrainWindow::Trapezoid)][i] = std::min(1.f, std::min(x, 1.f - x) * 5.f);
+	}
+}
+
+//--------------------------------------------------------------
+GranularVoice::~GranularVoice(){
+	collectGarbage();
+	s_grain_source* pending = mPending.exchange(nullptr);
+	if (pending != nullptr && !pending->live){
+		delete pending;
+	}
+	if (mSource != &mLive){
+		delete mSource;
+	}
+}
+
+//--------------------------------------------------------------
+void GranularVoice::setup(size_t rate){
+	sampleRate = rate;
+	mNextSpawn = 0.f;
+}
+
+//--------------------------------------------------------------
+float GranularVoice::random(){
+	// xorshift32, cheap and allocation free
+	mSeed ^= mSeed << 13;
+	mSeed ^= mSeed >> 17;
+	mSeed ^= mSeed << 5;
+	return (mSeed >> 8) * (1.f / 16777216.f);
+}
+
+//--------------------------------------------------------------
+void GranularVoice::writeSource(const float* left, const float* right, size_t numFrames){
+	mBlockStart = mWriteHead;
+	for (size_t i = 0; i < numFrames; i++){
+		mLive.data[(mWriteHead + i) & mLive.mask] = 0.5f * (left[i] + right[i]);
+	}
+	mWriteHead = (mWriteHead + numFrames) & mLive.mask;
+}
+
+//--------------------------------------------------------------
+void GranularVoice::setSample(const std::vector<float>& sample, size_t rate){
+	collectGarbage();
+	if (sample.empty()){
+		return;
+	}
+	size_t size = 1;
+	while (size < sample.size()){
+		size <<= 1;
+	}
+	s_grain_source* source = new s_grain_source;
+	source->data.assign(size, 0.f);
+	std::copy(sample.begin(), sample.end(), source->data.begin());
+	source->mask = size - 1;
+	source->length = sample.size();
+	source->rateRatio = float(rate) / float(sampleRate);
+	source->live = false;
+
+	s_grain_source* previous = mPending.exchange(source);
+	if (previous != nullptr && !previous->live){
+		delete previous;
+	}
+}
+
+//--------------------------------------------------------------
+void GranularVoice::useLiveSource(){
+	collectGarbage();
+	s_grain_source* previous = mPending.exchange(&mLive);
+	if (previous != nullptr && !previous->live){
+		delete previous;
+	}
+}
+
+//--------------------------------------------------------------
+void GranularVoice::collectGarbage(){
+	s_grain_source* retired = mRetired.exchange(nullptr);
+	if (retired != nullptr && !retired->live){
+		delete retired;
+	}
+}
+
+//--------------------------------------------------------------
+void GranularVoice::releaseAll(){
+	while (mActive != nullptr){
+		s_grain* next = mActive->next;
+		mPool.release(mActive);
+		mActive = next;
+	}
+}
+
+//--------------------------------------------------------------
+void GranularVoice::spawnGrain(int offset){
+	s_grain* grain = mPool.acquire();
+	if (grain == nullptr){
+		return;
+	}
+	int frames = std::max(1, int(grainSize * sampleRate));
+	float semitones = pitchJitter * (2.f * random() - 1.f);
+	float increment = pitch * mSource->rateRatio * exp2f(semitones / 12.f);
+	float size = float(mSource->mask + 1);
+	float start;
+	if (mSource->live){
+		// read behind the frame being written, far enough that a grain
+		// reading faster than real time never catches up with the write head
+		float span = std::max(0.f, size - frames * (std::max(increment, 1.f) + 1.f) - 2.f * liveMargin);
+		float delay = 2.f + frames * std::max(increment - 1.f, 0.f) + clamp01(position + positionJitter * random()) * span;
+		start = float(mBlockStart) + offset - delay;
+	} else {
+		// within the sample, not its padding
+		start = clamp01(position + positionJitter * (random() - 0.5f)) * float(mSource->length);
+	}
+	start = fmodf(start + size, size);
+
+	// grains overlap density * grainSize times on average, scale them so
+	// that the sum keeps the same loudness
+	float overlap = std::max(1.f, density * densityScale * grainSize);
+	float amplitude = gain / sqrtf(overlap);
+	float pan = 0.5f + spread * (random() - 0.5f);
+
+	grain->base = uint32_t(start);
+	grain->position = start - float(grain->base);
+	grain->increment = increment;
+	grain->windowPhase = 0.f;
+	grain->windowIncrement = float(windowSize) / frames;
+	grain->gainL = amplitude * (1.f - pan);
+	grain->gainR = amplitude * pan;
+	grain->offset = offset;
+	grain->remaining = frames;
+	grain->next = mActive;
+	mActive = grain;
+}
+
+//--------------------------------------------------------------
+void GranularVoice::process(float* left, float* right, size_t numFrames){
+	// swap sources only at a block boundary, and only once the GUI thread
+	// has freed the previously retired one
+	if (mRetired.load(std::memory_order_acquire) == nullptr){
+		s_grain_source* pending = mPending.exchange(nullptr, std::memory_order_acq_rel);
+		if (pending != nullptr){
+			releaseAll();
+			if (mSource != pending && !mSource->live){
+				mRetired.store(mSource, std::memory_order_release);
+			}
+			mSource = pending;
+		}
+	}
+
+	// at most a grain per frame: beyond, the interval would stop moving
+	// mNextSpawn forward; NaN spawns nothing
+	float spawnDensity = std::min(density * densityScale, float(sampleRate));
+	float interval = spawnDensity > 0.f ? sampleRate / spawnDensity : float(numFrames + 1);
+	while (spawnDensity > 0.f && mNextSpawn < numFrames){
+		spawnGrain(int(mNextSpawn));
+		mNextSpawn += interval;
+	}
+	mNextSpawn = std::max(0.f, mNextSpawn - numFrames);
+
+	// one grain at a time, mixed by the kernel picked for this CPU
+	const s_dsp_kernels& kernels = dspKernels();
+	const float* source = mSource->data.data();
+	const float* table = mWindows[static_cast<int>(window)].data();
+	s_grain** link = &mActive;
+	while (*link != nullptr){
+		s_grain* grain = *link;
+		int frames = std::min(grain->remaining, int(numFrames) - grain->offset);
+		kernels.mixGrain(source, mSource->mask, grain->base, grain->position, grain->increment,
+			table, grain->windowPhase, grain->windowIncrement,
+			grain->gainL, grain->gainR, left + grain->offset, right + grain->offset, frames);
+
+		float advanced = grain->position + frames * grain->increment;
+		uint32_t whole = uint32_t(advanced);
+		grain->base += whole;
+		grain->position = advanced - whole;
+		grain->windowPhase += frames * grain->windowIncrement;
+		grain->remaining -= frames;
+		grain->offset = 0;
+
+		if (grain->remaining <= 0){
+			*link = grain->next;
+			mPool.release(grain);
+		} else {
+			link = &grain->next;
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+enum class GrainWindow
+{
+	Hann,
+	Gauss,
+	Trapezoid,
+	sizeWindows,
+};
+
+typedef struct s_grain{
+	uint32_t base;          // integer read position in the source
+	float position;         // fractional read position, relative to base
+	float increment;        // read speed, i.e. pitch ratio
+	float windowPhase;      // read position in the window table
+	float windowIncrement;
+	float gainL;
+	float gainR;
+	int offset;             // first frame of the current block the grain sounds in
+	int remaining;          // frames left before the grain goes back to the pool
+	struct s_grain* next;   // intrusive link, either in the free list or the active list
+} s_grain;
+
+typedef struct{
+	std::vector<float> data;  // power of two length, read with a mask so that it loops
+	uint32_t mask;
+	uint32_t length;          // frames of sound, the padding up to the power of two is silent
+	float rateRatio;          // source sample rate / output sample rate
+	bool live;
+} s_grain_source;
+
+// Fixed capacity grain allocator. Every grain is allocated once by the
+// constructor, acquire() and release() only relink the intrusive free list,
+// so they can be called from audioOut.
+class GrainPool{
+
+	public:
+
+		GrainPool(size_t capacity);
+
+		s_grain* acquire();	// nullptr when the pool is exhausted
+		void release(s_grain* grain);
+		size_t capacity() const { return mGrains.size(); }
+		size_t used() const { return mUsed; }
+
+	private:
+
+		std::vector<s_grain> mGrains;
+		s_grain* mFreeList;
+		size_t mUsed;
+};
+
+// Granular voice: sprays short windowed grains read from either the live
+// output of the oscillators or a loaded sample.
+class GranularVoice{
+
+	public:
+
+		static constexpr size_t maxGrains = 4096;
+		static constexpr size_t windowSize = 2048;
+		static constexpr size_t liveSourceSize = 1 << 17; // about 3 s at 44.1 kHz
+		static constexpr float liveMargin = 4096.f;
+
+		GranularVoice();
+		~GranularVoice();
+
+		void setup(size_t sampleRate);
+
+		// audio thread
+		void writeSource(const float* left, const float* right, size_t numFrames);
+		void process(float* left, float* right, size_t numFrames);
+
+		// GUI thread: the new source is picked up at the next block boundary
+		void setSample(const std::vector<float>& sample, size_t sampleRate);
+		void useLiveSource();
+		void collectGarbage();
+
+		bool isLive() const { return mSource->live; }
+		size_t activeGrains() const { return mPool.used(); }
+
+		float density;          // grains per second
+		float grainSize;        // seconds
+		float pitch;            // playback ratio
+		float pitchJitter;      // semitones
+		float position;         // 0-1, in the sample or behind the live write head
+		float positionJitter;   // 0-1
+		float spread;           // 0-1, stereo spread
+		float gain;
+		GrainWindow window;
+		float densityScale;     // set by the audio thread, thins the cloud under load
+
+	private:
+
+		void spawnGrain(int offset);
+		void releaseAll();
+		float random();	// uniform in [0, 1)
+
+		GrainPool mPool;
+		s_grain* mActive;
+		std::vector<float> mWindows[static_cast<int>(GrainWindow::sizeWindows)];
+
+		s_grain_source mLive;
+		s_grain_source* mSource;
+		std::atomic<s_grain_source*> mPending;
+		std::atomic<s_grain_source*> mRetired;
+		uint32_t mWriteHead;
+		uint32_t mBlockStart;	// where the current block was written in the live source
+
+		size_t sampleRate;
+		float mNextSpawn;
+		uint32_t mSeed;
+};
@@ -0,0 +1,175 @@
+#include "jack_backend.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef SYNTH_WITH_JACK
+#include <jack/jack.h>
+#endif
+
+//--------------------------------------------------------------
+s_jack_settings parseJackArguments(int argc, char* argv[]){
+	s_jack_settings settings;
+	for (int i = 1; i < argc; i++){
+		std::string argument = argv[i];
+		if (argument == "--jack"){
+			settings.enabled = true;
+		} else if (argument == "--jack-no-connect"){
+			settings.autoConnect = false;
+		} else if (argument.rfind("--jack-name=", 0) == 0){
+			settings.clientName = argument.substr(strlen("--jack-name="));
+		} else if (argument.rfind("--jack-ports=", 0) == 0){
+			settings.numPorts = atoi(argument.c_str() + strlen("--jack-ports="));
+		}
+	}
+	return settings;
+}
+
+//--------------------------------------------------------------
+JackBackend::~JackBackend(){
+	close();
+}
+
+#ifdef SYNTH_WITH_JACK
+//--------------------------------------------------------------
+bool JackBackend::open(const s_jack_settings& settings, AudioRenderer* renderer, std::string& report){
+	close();
+	mSettings = settings;
+	mRenderer = renderer;
+	mShutdown.store(false);
+
+	jack_status_t status;
+	mClient = jack_client_open(settings.clientName.c_str(), JackNoStartServer, &status);
+	if (mClient == nullptr){
+		report += "no JACK server running (status 0x" + std::to_string(int(status)) + "), start one, e.g. jackd -d dummy. ";
+		return false;
+	}
+
+	// the master pair, then the dry pair
+	mNumPorts = std::max(2, std::min(settings.numPorts, maxPorts)) & ~1;
+	static const char* names[maxPorts] = {"out_left", "out_right", "dry_left", "dry_right"};
+	for (int i = 0; i < mNumPorts; i++){
+		mPorts[i] = jack_port_register(mClient, names[i], JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput | JackPortIsTerminal, 0);
+		if (mPorts[i] == nullptr){
+			report += "could not register the JACK port " + std::string(names[i]) + ". ";
+			close();
+			return false;
+		}
+	}
+
+	mOpenedSampleRate = jack_get_sample_rate(mClient);
+	mSampleRate.store(mOpenedSampleRate);
+	mBufferSize.store(jack_get_buffer_size(mClient));
+	jack_set_process_callback(mClient, &JackBackend::process, this);
+	jack_set_buffer_size_callback(mClient, &JackBackend::bufferSizeChanged, this);
+	jack_set_sample_rate_callback(mClient, &JackBackend::sampleRateChanged, this);
+	jack_on_shutdown(mClient, &JackBackend::shutdown, this);
+
+	report += "JACK client " + std::string(jack_get_client_name(mClient)) + ", " + std::to_string(mNumPorts) + " ports, "
+		+ std::to_string(bufferSize()) + " frames at " + std::to_string(sampleRate()) + " Hz. ";
+	return true;
+}
+
+//--------------------------------------------------------------
+bool JackBackend::start(std::string& report){
+	if (mClient == nullptr){
+		return false;
+	}
+	if (!mActive){
+		if (jack_activate(mClient) != 0){
+			report += "could not activate the JACK client. ";
+			return false;
+		}
+		mActive = true;
+	}
+	if (!mSettings.autoConnect){
+		return true;
+	}
+
+	// master to the first physical playback ports, the dry pair is left
+	// for the studio patchbay
+	const char** playback = jack_get_ports(mClient, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+	if (playback == nullptr){
+		report += "no physical playback port to connect to. ";
+		return true;
+	}
+	for (int i = 0; i < 2 && playback[i] != nullptr; i++){
+		int result = jack_connect(mClient, jack_port_name(mPorts[i]), playback[i]);
+		if (result != 0 && result != EEXIST){
+			report += "could not connect to " + std::string(playback[i]) + ". ";
+		}
+	}
+	jack_free(playback);
+	return true;
+}
+
+//--------------------------------------------------------------
+void JackBackend::stop(){
+	if (mClient != nullptr && mActive){
+		jack_deactivate(mClient);
+		mActive = false;
+	}
+}
+
+//--------------------------------------------------------------
+void JackBackend::close(){
+	if (mClient == nullptr){
+		return;
+	}
+	stop();
+	jack_client_close(mClient);
+	mClient = nullptr;
+	mNumPorts = 0;
+}
+
+//--------------------------------------------------------------
+int JackBackend::process(unsigned int numFrames, void* arg){
+	JackBackend* backend = static_cast<JackBackend*>(arg);
+	for (int i = 0; i < backend->mNumPorts; i++){
+		backend->mBuffers[i] = static_cast<float*>(jack_port_get_buffer(backend->mPorts[i], numFrames));
+	}
+	backend->mRenderer->renderBlock(backend->mBuffers, backend->mNumPorts, numFrames);
+	return 0;
+}
+
+//--------------------------------------------------------------
+int JackBackend::bufferSizeChanged(unsigned int numFrames, void* arg){
+	// JACK does not run the process callback meanwhile
+	JackBackend* backend = static_cast<JackBackend*>(arg);
+	backend->mBufferSize.store(numFrames);
+	backend->mRenderer->blockSizeChanged(numFrames);
+	return 0;
+}
+
+//--------------------------------------------------------------
+int JackBackend::sampleRateChanged(unsigned int rate, void* arg){
+	// the engine is set up for the rate read by open(), a later change is
+	// only reported, see sampleRateMismatch()
+	static_cast<JackBackend*>(arg)->mSampleRate.store(rate);
+	return 0;
+}
+
+//--------------------------------------------------------------
+void JackBackend::shutdown(void* arg){
+	static_cast<JackBackend*>(arg)->mShutdown.store(true);
+}
+
+#else
+
+// Without JACK the parameters are left unnamed, nothing reads them.
+//--------------------------------------------------------------
+bool JackBackend::open(const s_jack_settings&, AudioRenderer*, std::string& report){
+	report += "built without JACK, install its development files and rebuild (see config.make). ";
+	return false;
+}
+
+bool JackBackend::start(std::string&){ return false; }
+void JackBackend::stop(){}
+void JackBackend::close(){}
+int JackBackend::process(unsigned int, void*){ return 0; }
+int JackBackend::bufferSizeChanged(unsigned int, void*){ return 0; }
+int JackBackend::sampleRateChanged(unsigned int, void*){ return 0; }
+void JackBackend::shutdown(void*){}
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// same opaque types as <jack/types.h>, so that this header does not need it
+typedef struct _jack_client jack_client_t;
+typedef struct _jack_port jack_port_t;
+
+// What an audio backend drives. outputs are planar, one buffer per port.
+class AudioRenderer{
+
+	public:
+
+		virtual ~AudioRenderer(){}
+		virtual void renderBlock(float* const* outputs, int numOutputs, size_t numFrames) = 0;
+		virtual void blockSizeChanged(size_t numFrames) = 0;	// never called during renderBlock
+};
+
+typedef struct{
+	bool enabled = false;				// --jack
+	std::string clientName = "synthesizer";	// --jack-name=
+	int numPorts = 2;					// --jack-ports=2 or 4: master, then dry
+	bool autoConnect = true;			// --jack-no-connect leaves the ports alone
+} s_jack_settings;
+
+s_jack_settings parseJackArguments(int argc, char* argv[]);
+
+// Native JACK client. The process callback hands the port buffers of the
+// cycle to the renderer, which writes into them directly: no interleaving,
+// no intermediate ring buffer and no resampling. Built only when
+// SYNTH_WITH_JACK is defined, see config.make; otherwise open() fails with
+// an explanation and the app keeps using ofSoundStream.
+class JackBackend{
+
+	public:
+
+		static constexpr int maxPorts = 4;
+
+		~JackBackend();
+
+		// registers the client and its ports, the engine can then be set up
+		// with bufferSize() and sampleRate() before start()
+		bool open(const s_jack_settings& settings, AudioRenderer* renderer, std::string& report);
+		bool start(std::string& report);	// activates, then connects to the physical outputs
+		void stop();
+		void close();
+
+		bool isOpen() const { return mClient != nullptr; }
+		size_t bufferSize() const { return mBufferSize.load(std::memory_order_relaxed); }
+		size_t sampleRate() const { return mSampleRate.load(std::memory_order_relaxed); }
+		bool sampleRateMismatch() const { return mSampleRate.load(std::memory_order_relaxed) != mOpenedSampleRate; }
+		bool isShutdown() const { return mShutdown.load(std::memory_order_relaxed); }
+
+	private:
+
+		static int process(unsigned int numFrames, void* arg);
+		static int bufferSizeChanged(unsigned int numFrames, void* arg);
+		static int sampleRateChanged(unsigned int rate, void* arg);
+		static void shutdown(void* arg);
+
+		jack_client_t* mClient = nullptr;
+		AudioRenderer* mRenderer = nullptr;
+		s_jack_settings mSettings;
+		jack_port_t* mPorts[maxPorts] = {};
+		float* mBuffers[maxPorts] = {};
+		int mNumPorts = 0;
+		bool mActive = false;
+		size_t mOpenedSampleRate = 0;
+		std::atomic<size_t> mBufferSize{0};
+		std::atomic<size_t> mSampleRate{0};
+		std::atomic<bool> mShutdown{false};
+};
@@ -0,0 +1,152 @@
+#include "limiter.h"
+#include <cmath>
+#include <algorithm>
+
+// delay of the true peak interpolator, in samples (half its taps per phase)
+static const int interpolatorDelay = 6;
+static const int interpolatorTaps = 2 * interpolatorDelay;
+static const size_t interpolatorHistory = 16;	// power of two >= interpolatorTaps
+
+//--------------------------------------------------------------
+void SlidingMax::setup(size_t maxWindow){
+	mEntries.assign(maxWindow + 1, s_entry{0, 0.f});
+	reset(maxWindow);
+}
+
+//--------------------------------------------------------------
+void SlidingMax::reset(size_t window){
+	mWindow = std::max<size_t>(1, std::min(window, mEntries.size() - 1));
+	mFront = 0;
+	mSize = 0;
+	mIndex = 0;
+}
+
+//--------------------------------------------------------------
+float SlidingMax::push(float value){
+	const size_t capacity = mEntries.size();
+	// values smaller than the new one can never be the maximum again
+	while (mSize > 0 && mEntries[(mFront + mSize - 1) % capacity].value <= value){
+		mSize--;
+	}
+	mEntries[(mFront + mSize) % capacity] = s_entry{mIndex, value};
+	mSize++;
+	// drop the front once it has left the window
+	while (mEntries[mFront].index + mWindow <= mIndex){
+		mFront = (mFront + 1) % capacity;
+		mSize--;
+	}
+	mIndex++;
+	return mEntries[mFront].value;
+}
+
+//--------------------------------------------------------------
+void LookaheadLimiter::setup(size_t rate){
+	sampleRate = rate;
+	size_t maxLookahead = (size_t) ceil(maxLookaheadMs * sampleRate / 1000.f);
+	mPeak.setup(maxLookahead);
+	mSmoother.assign(maxLookahead, 1.f);
+	mDelayL.assign(maxLookahead + interpolatorDelay + 1, 0.f);
+	mDelayR.assign(maxLookahead + interpolatorDelay + 1, 0.f);
+	mHistoryL.assign(interpolatorHistory, 0.f);
+	mHistoryR.assign(interpolatorHistory, 0.f);
+
+	// phase p of tap k sits at 4 k + p of a windowed sinc centred on 4 * delay
+	mInterpolator.assign(4 * interpolatorTaps, 0.f);
+	for (int i = 0; i < 4 * interpolatorTaps; i++){
+		double x = (i - 4.0 * interpolatorDelay) / 4.0;
+		double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+		double window = 0.5 + 0.5 * cos(M_PI * (i - 4.0 * interpolatorDelay) / (4.0 * interpolatorDelay + 1.0));
+		mInterpolator[i] = sinc * window;
+	}
+	mAppliedLookaheadMs = -1.f;
+	configure();
+}
+
+//--------------------------------------------------------------
+void LookaheadLimiter::configure(){
+	float ms = std::min(maxLookaheadMs, std::max(minLookaheadMs, lookaheadMs));
+	mLookahead = std::max<size_t>(1, std::min(mSmoother.size(), (size_t) lround(ms * sampleRate / 1000.f)));
+	mAppliedLookaheadMs = lookaheadMs;
+	mAppliedTruePeak = truePeak;
+
+	mPeak.reset(mLookahead);
+	std::fill(mSmoother.begin(), mSmoother.end(), 1.f);
+	mSmootherWrite = 0;
+	mSmootherSum = double(mLookahead);
+	mReleased = 1.f;
+	mReleaseCoefficient = exp(-1000.f / (releaseMs * sampleRate));
+
+	std::fill(mDelayL.begin(), mDelayL.end(), 0.f);
+	std::fill(mDelayR.begin(), mDelayR.end(), 0.f);
+	mDelay = (mLookahead - 1) + (truePeak ? interpolatorDelay : 0);
+	mDelayWrite = 0;
+	std::fill(mHistoryL.begin(), mHistoryL.end(), 0.f);
+	std::fill(mHistoryR.begin(), mHistoryR.end(), 0.f);
+	mHistoryWrite = 0;
+}
+
+//--------------------------------------------------------------
+int LookaheadLimiter::latency() const {
+	return (int) mDelay;
+}
+
+//--------------------------------------------------------------
+float LookaheadLimiter::detect(float left, float right){
+	if (!truePeak){
+		return std::max(fabsf(left), fabsf(right));
+	}
+	const size_t mask = interpolatorHistory - 1;
+	mHistoryL[mHistoryWrite] = left;
+	mHistoryR[mHistoryWrite] = right;
+
+	// the sample itself, delayed like the interpolated points that follow it
+	size_t centre = (mHistoryWrite - interpolatorDelay) & mask;
+	float peak = std::max(fabsf(mHistoryL[centre]), fabsf(mHistoryR[centre]));
+	for (int p = 1; p < 4; p++){
+		float l = 0.f;
+		float r = 0.f;
+		for (int k = 0; k < interpolatorTaps; k++){
+			size_t index = (mHistoryWrite - k) & mask;
+			l += mHistoryL[index] * mInterpolator[4 * k + p];
+			r += mHistoryR[index] * mInterpolator[4 * k + p];
+		}
+		peak = std::max(peak, std::max(fabsf(l), fabsf(r)));
+	}
+	mHistoryWrite = (mHistoryWrite + 1) & mask;
+	return peak;
+}
+
+//--------------------------------------------------------------
+void LookaheadLimiter::process(float* left, float* right, size_t numFrames){
+	if (lookaheadMs != mAppliedLookaheadMs || truePeak != mAppliedTruePeak){
+		configure();
+	}
+	const size_t delaySize = mDelayL.size();
+	const float release = 1.f - mReleaseCoefficient;
+	float lowest = 1.f;
+
+	for (size_t i = 0; i < numFrames; i++){
+		// gain needed by the loudest peak of the lookahead window, released
+		// slowly but never above what the window asks for
+		float peak = mPeak.push(detect(left[i], right[i]));
+		float held = (peak > ceiling) ? ceiling / peak : 1.f;
+		mReleased = std::min(held, mReleased + (1.f - mReleased) * release);
+
+		// averaging the last mLookahead gains reaches any held value by the
+		// time its peak comes out of the delay line
+		mSmootherSum += mReleased - mSmoother[mSmootherWrite];
+		mSmoother[mSmootherWrite] = mReleased;
+		mSmootherWrite = (mSmootherWrite + 1 == mLookahead) ? 0 : mSmootherWrite + 1;
+		float gain = std::min(1.f, float(mSmootherSum / mLookahead));
+
+		mDelayL[mDelayWrite] = left[i];
+		mDelayR[mDelayWrite] = right[i];
+		size_t read = (mDelayWrite + delaySize - mDelay) % delaySize;
+		left[i] = mDelayL[read] * gain;
+		right[i] = mDelayR[read] * gain;
+		mDelayWrite = (mDelayWrite + 1 == delaySize) ? 0 : mDelayWrite + 1;
+
+		lowest = std::min(lowest, gain);
+	}
+	mGainReduction = lowest;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Sliding window maximum over the last `window` pushed values. The deque
+// only keeps values that can still become the maximum, in decreasing
+// order, so each push costs O(1) amortized. Storage is a fixed ring
+// allocated by setup().
+class SlidingMax{
+
+	public:
+
+		void setup(size_t maxWindow);
+		void reset(size_t window);
+		float push(float value);	// returns the maximum of the window ending with value
+
+	private:
+
+		typedef struct{
+			size_t index;
+			float value;
+		} s_entry;
+
+		std::vector<s_entry> mEntries;
+		size_t mFront = 0;
+		size_t mSize = 0;
+		size_t mIndex = 0;
+		size_t mWindow = 1;
+};
+
+// Stereo linked lookahead brickwall limiter. The output is delayed by the
+// lookahead, so the gain has already reached its target when a peak leaves
+// the delay line and nothing above the ceiling gets through.
+class LookaheadLimiter{
+
+	public:
+
+		static constexpr float maxLookaheadMs = 5.f;
+		static constexpr float minLookaheadMs = 1.f;
+
+		void setup(size_t sampleRate);
+		void process(float* left, float* right, size_t numFrames);
+		float gainReduction() const { return mGainReduction; }	// lowest gain of the last block
+		int latency() const;	// in samples
+
+		float lookaheadMs = 2.f;
+		float releaseMs = 80.f;
+		float ceiling = 0.966f;	// -0.3 dBFS
+		bool truePeak = false;	// estimate inter-sample peaks with a 4x interpolator
+
+	private:
+
+		void configure();
+		float detect(float left, float right);
+
+		size_t sampleRate = 44100;
+		float mAppliedLookaheadMs = -1.f;
+		bool mAppliedTruePeak = false;
+		size_t mLookahead = 1;	// window of the peak detector and of the gain smoother, in samples
+
+		SlidingMax mPeak;
+		std::vector<float> mDelayL;
+		std::vector<float> mDelayR;
+		size_t mDelay = 0;
+		size_t mDelayWrite = 0;
+
+		std::vector<float> mSmoother;	// ring of the last mLookahead gains
+		size_t mSmootherWrite = 0;
+		double mSmootherSum = 0.0;
+		float mReleased = 1.f;
+		float mReleaseCoefficient = 0.f;
+
+		std::vector<float> mInterpolator;	// 4x windowed sinc, 12 taps per phase
+		std::vector<float> mHistoryL;
+		std::vector<float> mHistoryR;
+		size_t mHistoryWrite = 0;
+
+		float mGainReduction = 1.f;
+};
@@ -1,17 +1,37 @@
 #include "ofMain.h"
+#include "ofAppNoWindow.h"
 #include "ofApp.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char* argv[]){
+
+	// --realtime, --jack, --tap, --headless and --stft-..., with their
+	// options, see realtime.h, jack_backend.h, shared_tap.h, osc_server.h
+	// and spectrogram.h
+	auto app = make_shared<ofApp>();
+	app->realtimeSettings = parseRealtimeArguments(argc, argv);
+	app->jackSettings = parseJackArguments(argc, argv);
+	app->tapSettings = parseTapArguments(argc, argv);
+	app->serverSettings = parseServerArguments(argc, argv);
+	app->spectrogramSettings = parseSpectrogramArguments(argc, argv);
+
+	if (app->serverSettings.headless){
+		// no window nor GL context, controlled over OSC only
+		ofInit();
+		auto window = make_shared<ofAppNoWindow>();
+		ofGetMainLoop()->addWindow(window);
+		ofRunApp(window, app);
+		return ofRunMainLoop();
+	}
 
 	//Use ofGLFWWindowSettings for more options like multi-monitor fullscreen
 	ofGLWindowSettings settings;
-	settings.setSize(1024, 968);
+	settings.setSize(1880, 840);	// fits a 1920x1080 screen
 	settings.windowMode = OF_WINDOW; //can also be OF_FULLSCREEN
 
 	auto window = ofCreateWindow(settings);
 
-	ofRunApp(window, make_shared<ofApp>());
+	ofRunApp(window, app);
 	ofRunMainLoop();
 
 }
@@ -0,0 +1,169 @@
+#include "modulation.h"
+#include <algorithm>
+#include <cmath>
+
+//--------------------------------------------------------------
+s_modulation_settings defaultModulation(){
+	s_modulation_settings settings;
+	for (int i = 0; i < maxModulators; i++){
+		settings.modulators[i] = {ModShape::Sine, 1.f, 0.01f, 0.2f, 0.7f, 0.3f};
+	}
+	for (int i = 0; i < maxModRoutes; i++){
+		settings.routes[i] = {0, ModTarget::Pitch, 0.f};
+	}
+	return settings;
+}
+
+//--------------------------------------------------------------
+const char* modShapeName(ModShape shape){
+	static const char* names[] = {"sine", "triangle", "s&h", "envelope"};
+	int index = static_cast<int>(shape);
+	return (index >= 0 && index < static_cast<int>(ModShape::sizeShapes)) ? names[index] : "";
+}
+
+//--------------------------------------------------------------
+const char* modTargetName(ModTarget target){
+	static const char* names[] = {"pitch", "volume", "brillance", "cutoff", "q", "pan"};
+	int index = static_cast<int>(target);
+	return (index >= 0 && index < static_cast<int>(ModTarget::sizeTargets)) ? names[index] : "";
+}
+
+//--------------------------------------------------------------
+void ModulationMatrix::setup(size_t rate){
+	sampleRate = rate;
+	configure(defaultModulation());
+}
+
+//--------------------------------------------------------------
+void ModulationMatrix::configure(const s_modulation_settings& settings){
+	mSettings = settings;
+	mActive = false;
+	// settings come from the network and from bank files: no NaN reaches
+	// the targets, and a depth cannot take the pitch out of hearing
+	const s_modulator_settings defaults = defaultModulation().modulators[0];
+	auto finiteOr = [](float& value, float fallback){
+		if (!std::isfinite(value)){
+			value = fallback;
+		}
+	};
+	for (auto& modulator : mSettings.modulators){
+		finiteOr(modulator.rate, defaults.rate);
+		finiteOr(modulator.attack, defaults.attack);
+		finiteOr(modulator.decay, defaults.decay);
+		finiteOr(modulator.sustain, defaults.sustain);
+		finiteOr(modulator.release, defaults.release);
+	}
+	for (auto& route : mSettings.routes){
+		route.source = std::min(std::max(route.source, 0), maxModulators - 1);
+		route.depth = std::isfinite(route.depth) ? std::clamp(route.depth, -maxModDepth, maxModDepth) : 0.f;
+		mActive = mActive || (route.depth != 0.f);
+	}
+	// the phases keep running, a new patch does not restart its LFOs
+	advance(0);
+}
+
+//--------------------------------------------------------------
+void ModulationMatrix::gate(bool on, bool retrigger){
+	for (int i = 0; i < maxModulators; i++){
+		if (on && (retrigger || !mGate)){
+			mStage[i] = 1;
+		} else if (!on && mGate){
+			mStage[i] = 4;
+		}
+	}
+	mGate = on;
+}
+
+//--------------------------------------------------------------
+void ModulationMatrix::advance(size_t numFrames){
+	const float dt = float(numFrames) / float(sampleRate);
+
+	// phases of every slot, whatever its shape
+	for (int i = 0; i < maxModulators; i++){
+		float phase = mPhase[i] + mSettings.modulators[i].rate * dt;
+		if (phase >= 1.f){
+			phase -= std::floor(phase);
+			// a new value for the sample and hold at every period
+			mSeed = mSeed * 1664525u + 1013904223u;
+			mHeld[i] = float(mSeed >> 8) * (2.f / 16777216.f) - 1.f;
+		}
+		mPhase[i] = phase;
+	}
+
+	for (int i = 0; i < maxModulators; i++){
+		const s_modulator_settings& modulator = mSettings.modulators[i];
+		switch (modulator.shape){
+			case ModShape::Sine:
+				mValue[i] = std::sin(6.28318530718f * mPhase[i]);
+				break;
+			case ModShape::Triangle:
+				mValue[i] = 1.f - 4.f * std::fabs(mPhase[i] - 0.5f);
+				break;
+			case ModShape::SampleAndHold:
+				mValue[i] = mHeld[i];
+				break;
+			case ModShape::Envelope:{
+				// linear segments, one step per control block
+				float level = mValue[i];
+				switch (mStage[i]){
+					case 1:
+						level += dt / std::max(modulator.attack, 1e-4f);
+						if (level >= 1.f){
+							level = 1.f;
+							mStage[i] = 2;
+						}
+						break;
+					case 2:
+						level -= dt * (1.f - modulator.sustain) / std::max(modulator.decay, 1e-4f);
+						if (level <= modulator.sustain){
+							level = modulator.sustain;
+							mStage[i] = 3;
+						}
+						break;
+					case 3:
+						level = modulator.sustain;
+						break;
+					case 4:
+						level -= dt / std::max(modulator.release, 1e-4f);
+						if (level <= 0.f){
+							level = 0.f;
+							mStage[i] = 0;
+						}
+						break;
+					default:
+						level = 0.f;
+						break;
+				}
+				mValue[i] = level;
+				break;
+			}
+			default:
+				mValue[i] = 0.f;
+				break;
+		}
+	}
+
+	for (int t = 0; t < static_cast<int>(ModTarget::sizeTargets); t++){
+		mTargets[t] = 0.f;
+	}
+	float gain = 1.f;
+	for (const auto& route : mSettings.routes){
+		if (route.depth == 0.f){
+			continue;
+		}
+		float value = mValue[route.source];
+		if (route.target == ModTarget::Volume){
+			float centre = (mSettings.modulators[route.source].shape == ModShape::Envelope) ? 1.f : 0.f;
+			gain *= std::max(0.f, 1.f + route.depth * (value - centre));
+		} else {
+			mTargets[static_cast<int>(route.target)] += route.depth * value;
+		}
+	}
+	mTargets[static_cast<int>(ModTarget::Volume)] = gain;
+	float& pitch = mTargets[static_cast<int>(ModTarget::Pitch)];
+	pitch = std::clamp(pitch, -maxPitchModulation, maxPitchModulation);
+	for (ModTarget target : {ModTarget::Brillance, ModTarget::FilterCutoff, ModTarget::FilterQ}){
+		float& octaves = mTargets[static_cast<int>(target)];
+		octaves = std::clamp(octaves, -maxOctaveModulation, maxOctaveModulation);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum class ModShape
+{
+	Sine,			// LFOs, bipolar
+	Triangle,
+	SampleAndHold,
+	Envelope,		// ADSR gated by the notes, unipolar
+	sizeShapes,
+};
+
+enum class ModTarget
+{
+	Pitch,			// semitones
+	Volume,			// gain factor, see ModulationMatrix
+	Brillance,		// octaves of harmonics
+	FilterCutoff,	// octaves
+	FilterQ,		// octaves
+	Pan,			// -1 left, 1 right
+	sizeTargets,
+};
+
+typedef struct{
+	ModShape shape;
+	float rate;			// Hz, LFOs
+	float attack;		// seconds, envelopes
+	float decay;
+	float sustain;		// 0-1
+	float release;
+} s_modulator_settings;
+
+typedef struct{
+	int source;			// modulator slot
+	ModTarget target;
+	float depth;		// 0: route unused
+} s_mod_route;
+
+static constexpr int maxModulators = 4;
+static constexpr int maxModRoutes = 8;
+static constexpr float maxModDepth = 48.f;		// route depths are clamped to +-maxModDepth
+static constexpr float maxPitchModulation = 48.f;	// semitones, the summed Pitch target
+static constexpr float maxOctaveModulation = 8.f;	// the summed Brillance, FilterCutoff and FilterQ targets
+
+typedef struct{
+	s_modulator_settings modulators[maxModulators];
+	s_mod_route routes[maxModRoutes];
+} s_modulation_settings;
+
+s_modulation_settings defaultModulation();	// no route
+const char* modShapeName(ModShape shape);
+const char* modTargetName(ModTarget target);
+
+// Modulators evaluated once per control block rather than per sample. The
+// state of all modulators sits in flat arrays, one per field, so that a
+// control step is a few short loops. The engine ramps every target linearly
+// from one control block to the next.
+//
+// Targets add the depth weighted outputs of their routes, except Volume
+// which multiplies 1 + depth * (output - centre): a tremolo for an LFO
+// (centre 0), a VCA for an envelope of depth 1 (centre 1).
+class ModulationMatrix{
+
+	public:
+
+		static constexpr size_t controlBlockSize = 32;	// frames at the base rate
+
+		void setup(size_t sampleRate);
+		void configure(const s_modulation_settings& settings);
+		const s_modulation_settings& settings() const { return mSettings; }
+		bool isActive() const { return mActive; }
+
+		// envelopes: on at every new note, off when no note is left
+		void gate(bool on, bool retrigger);
+
+		// moves every modulator numFrames forward, then updates the targets
+		void advance(size_t numFrames);
+		float target(ModTarget target) const { return mTargets[static_cast<int>(target)]; }
+		float output(int slot) const { return mValue[slot]; }
+
+	private:
+
+		s_modulation_settings mSettings;
+		bool mActive = false;
+		size_t sampleRate = 44100;
+		uint32_t mSeed = 0x2545F491u;
+		bool mGate = false;
+
+		// modulator state, structure of arrays
+		float mPhase[maxModulators] = {};
+		float mValue[maxModulators] = {};
+		float mHeld[maxModulators] = {};
+		int mStage[maxModulators] = {};		// envelopes: 0 idle, 1 attack, 2 decay, 3 sustain, 4 release
+		float mTargets[static_cast<int>(ModTarget::sizeTargets)] = {};
+};
@@ -1,201 +1,46 @@
 #include "ofApp.h"
+#include "wavfile.h"
 #include <complex>
 #include <math.h>
 #include <iostream>
 
 
 //--------------------------------------------------------------
-void ofApp::addSignal_sin(s_signal& signal){
-	float pan = 0.5f;
-	float leftScale = 1 - pan;
-	float rightScale = pan;
-
-    float& phase = signal.phase;
-    float volume = signal.volume;
-    float freq = signal.frequency;
-
-	// sin (n) seems to have trouble when n is very large, so we
-	// keep phase in the range of 0-TWO_PI like this:
-
-    for (size_t i = 0; i < bufferSize; i++){
-		while (phase > TWO_PI){
-			phase -= TWO_PI;
-		}
-		float sample = 0;
-		for (int i = 1; i <= mBrillance; i++){
-			sample+=sin(i * phase);
-			}
-		// sample+=sin(mBrillance * phase)/mBrillance;
-		// sample+=sin(phase);
-        lAudio[i] += sample * volume * leftScale;
-        rAudio[i] += sample * volume * rightScale;
-        phase += 2.0 * M_PI * freq / ((float) sampleRate); // 2Pi * freq * dt;
-    }
-}
-
-//--------------------------------------------------------------
-void ofApp::addSignal_saw(s_signal& signal){
-	float pan = 0.5f;
-	float leftScale = 1 - pan;
-	float rightScale = pan;
-
-    float& phase = signal.phase;
-    float volume = signal.volume;
-    float freq = signal.frequency;
-
-	// sin (n) seems to have trouble when n is very large, so we
-	// keep phase in the range of 0-TWO_PI like this:
-
-    for (size_t i = 0; i < bufferSize; i++){
-		while (phase > TWO_PI){
-			phase -= TWO_PI;
-		}
-		float sample = 0;
-		int sign = 1;
-		for (int i = 1; i <= mBrillance; i++){
-			sample+= ((float) sign)*sin(i * phase)/ ((float)i);
-			sign *= -1;
-			}
-        lAudio[i] += sample * volume * leftScale;
-        rAudio[i] += sample * volume * rightScale;
-        phase += 2.0 * M_PI * freq / ((float) sampleRate); // 2Pi * freq * dt;
-    }
-}
-
-//--------------------------------------------------------------
-void ofApp::addSignal_square(s_signal& signal){
-	float pan = 0.5f;
-	float leftScale = 1 - pan;
-	float rightScale = pan;
-
-    float& phase = signal.phase;
-    float volume = signal.volume;
-    float freq = signal.frequency;
-
-	// sin (n) seems to have trouble when n is very large, so we
-	// keep phase in the range of 0-TWO_PI like this:
-
-    for (size_t i = 0; i < bufferSize; i++){
-		while (phase > TWO_PI){
-			phase -= TWO_PI;
-		}
-		float sample = 0;
-
-		for (int i = 1; i <= mBrillance; i+=2){
-			sample+=sin(i * phase)/float(i);
-			}
-        lAudio[i] += sample * volume * leftScale;
-        rAudio[i] += sample * volume * rightScale;
-        phase += 2.0 * M_PI * freq / ((float) sampleRate); // 2Pi * freq * dt;
-    }
-}
-
-void ofApp::initSignal(){
-	for (size_t i = 0; i < bufferSize; i++){
-		lAudio[i] = 0.;
-		rAudio[i] = 0.;
-    }
-}
-
-void ofApp::synthesizeSquaredSignal(float frequency, int brillance){
-	for(int k=0; k<brillance; k++){
-		s_signal signal(0., (float(2*k+1)*frequency), volume /((float)(2*k+1)));
-		signals.push_back(signal);
-	}
-}
-
-void ofApp::synthesizeSawToothSignal(float frequency, int brillance){
-	float sign = 1.;
-	for(int k=0; k<brillance; k++){
-		s_signal signal(0., (float(k+1)*frequency), sign * volume /((float)(k+1)));
-		signals.push_back(signal);
-		sign = -sign;
-	}
-}
-
-s_filter ofApp::lowPassFilter(float frequency, float Q){
-	float omega_0 = TWO_PI * frequency / sampleRate;
-	float cos_omega_0 = cos(omega_0);
-	float alpha = sin(omega_0) / (2.0f * Q);
-	s_filter filter;
-	float a_0 = 1.0+alpha;
-	filter.a_1 = (-2. * cos_omega_0) / a_0;
-	filter.a_2 = (1.0 - alpha) / a_0;
-	filter.b_1 = (1.0 - cos_omega_0) / (a_0);
-	filter.b_0 =  filter.b_1 / 2.0;
-	filter.b_2 = filter.b_0;
-	return filter;
-}
-
-s_filter ofApp::highPassFilter(float frequency, float Q){
-	float omega_0 = TWO_PI * frequency / sampleRate;
-	float cos_omega_0 = cos(omega_0);
-	float alpha = sin(omega_0) / (2.0f * Q);
-	s_filter filter;
-	float a_0 = 1.0+alpha;
-	filter.a_1 = (-2. * cos_omega_0) / a_0;
-	filter.a_2 = (1.0 - alpha) / a_0;
-	filter.b_1 = -(1.0 + cos_omega_0) / (a_0);
-	filter.b_0 = - filter.b_1 / 2.0;
-	filter.b_2 = filter.b_0;
-	return filter;
-}
-
-void ofApp::applyFilter(s_filter filter){
-	for(size_t i=0; i < bufferSize; i++){
-		lAudioFiltered[i] = filter.b_0 * lAudio[i] \ 
-			+ filter.b_1 * lAudioPreviousValues.x_1 \
-			+ filter.b_2 * lAudioPreviousValues.x_2 \
-			- filter.a_1 * lAudioPreviousValues.y_1 \
-			- filter.a_2 * lAudioPreviousValues.y_2;
-		lAudioPreviousValues.x_2 = lAudioPreviousValues.x_1;
-		lAudioPreviousValues.x_1 = lAudio[i];
-		lAudioPreviousValues.y_2 = lAudioPreviousValues.y_1;
-		lAudioPreviousValues.y_1 = lAudioFiltered[i];
-
-		rAudioFiltered[i] = filter.b_0 * rAudio[i] \ 
-			+ filter.b_1 * rAudioPreviousValues.x_1 \
-			+ filter.b_2 * rAudioPreviousValues.x_2 \
-			- filter.a_1 * rAudioPreviousValues.y_1 \
-			- filter.a_2 * rAudioPreviousValues.y_2;
-		rAudioPreviousValues.x_2 = rAudioPreviousValues.x_1;
-		rAudioPreviousValues.x_1 = rAudio[i]; 
-		rAudioPreviousValues.y_2 = rAudioPreviousValues.y_1;
-		rAudioPreviousValues.y_1 = rAudioFiltered[i];
-	}
-}
-
 void ofApp::setup(){
 
 	ofBackground(34, 34, 34);
 
 	bufferSize = soundStream.getBufferSize();
 	sampleRate = soundStream.getSampleRate();
+	// with --jack the server imposes both, the engine follows
+	if (jackSettings.enabled){
+		if (jack.open(jackSettings, &engine, audioBackendReport)){
+			bufferSize = jack.bufferSize();
+			sampleRate = jack.sampleRate();
+		} else {
+			audioBackendReport += "falling back to ofSoundStream.";
+		}
+		std::cout << audioBackendReport << std::endl;
+	}
 	// bufferSize		= 512;
 	// sampleRate 		= 44100;
 
 	std::cout << "Buffer Size is " << bufferSize << std::endl;
 	std::cout << "Sample Rate is " << sampleRate << std::endl;
+	std::cout << "DSP kernels are " << dspKernels().name << std::endl;
+
+	// the engine allocates everything the audio thread touches
+	engine.prefaultStack = realtimeSettings.enabled;
+	engine.spectrogramSettings = spectrogramSettings;
+	engine.setup(bufferSize, sampleRate);
 
 	phase 				= 0;
 	phaseAdder 			= 0.0f;
 	phaseAdderTarget 	= 0.0f;
-	volume				= 0.1f;
 	bNoise 				= false;
-	octaveIndex			= 4;
 	mNote				= Notes::No_sound;
-	mBrillance			= 1;
 	targetFrequency 	= 0.;
 
-	mWaveShape			=WaveShape::Sin;
-
-	lAudio.assign(bufferSize, 0.0);
-	rAudio.assign(bufferSize, 0.0);
-	dftAudio.assign(bufferSize, 0.0);
-	dftAudioNorm.assign(bufferSize, 0.0); 
-	
-	soundStream.printDeviceList();
-
 	ofSoundStreamSettings settings;
 
 	// To be removed as we want to trigger ourself the signals	
@@ -234,12 +79,16 @@ void ofApp::setup(){
 	}
 #endif
 
-	settings.setOutListener(this);
-	settings.sampleRate = sampleRate;
-	settings.numOutputChannels = 2;
-	settings.numInputChannels = 0;
-	settings.bufferSize = bufferSize;
-	soundStream.setup(settings);
+	if (!jack.isOpen()){
+		soundStream.printDeviceList();
+		settings.setOutListener(this);
+		settings.sampleRate = sampleRate;
+		settings.numOutputChannels = 2;
+		settings.numInputChannels = 0;
+		settings.bufferSize = bufferSize;
+		soundStream.setup(settings);
+		audioBackendReport = "ofSoundStream";
+	}
 
 	// on OSX: if you want to use ofSoundPlayer together with ofSoundStream you need to synchronize buffersizes.
 	// use ofFmodSetBuffersize(bufferSize) to set the buffersize in fmodx prior to loading a file.
@@ -251,17 +100,9 @@ void ofApp::setup(){
 	// 	signal.volume = 0.0f;
 	// }
 
-	// Filtering 
+	// Filtered output, interleaved by audioOut
 	rAudioFiltered.assign(bufferSize, 0.0);
 	lAudioFiltered.assign(bufferSize, 0.0);
-	lAudioPreviousValues = s_previous_values(0.f,0.f,0.f,0.f);
-	rAudioPreviousValues = s_previous_values(0.f,0.f,0.f,0.f);
-	lowFrequency = 500;
-	highFrequency = 10000;
-	lowQ = 0.1;
-	highQ = 0.1;
-	lowFilter = lowPassFilter(lowFrequency, lowQ);
-	highFilter = highPassFilter(highFrequency, highQ);
 	//----------------------------------- for the change of the shape of the wave
 	buttonX = 600;
     buttonY = 80;
@@ -276,231 +117,361 @@ void ofApp::setup(){
     buttonHeight = 50; // Adjust the size as needed
     buttonPressed_saw = false;
 	sawWaveEnabled = false; // Start with SAW waveform disabled
-	
+	shownWaveShape = engine.mWaveShape;
+
+	// Realtime mode : the memory and the GUI thread are handled here, the
+	// audio thread in update() once audioOut has run
+	realtimeApplied = false;
+	realtimeReport = realtimeSettings.enabled ? "" : "off, run with --realtime";
+
+	// Patches : the bank is mapped, the patches are prepared by the loader
+	// thread of the engine and applied by the audio thread
+	string bankPath = ofToDataPath("patches.bank", true);
+	patchReport = "";
+	if (!engine.patches.openBank(bankPath, patchReport)){
+		patchReport = "";
+		if (PatchBank::save(bankPath, factoryPatches(), patchReport)){
+			engine.patches.openBank(bankPath, patchReport);
+		}
+	}
+	std::cout << "patches: " << bankPath << ", " << engine.patches.bankSize() << " patches " << patchReport << std::endl;
+
+	// Headless server : OSC over UDP, applied by the audio thread
+	serverReport = "off, run with --osc or --headless";
+	serverPreviousReceived = 0;
+	serverPreviousTime = 0.f;
+	if (serverSettings.enabled){
+		serverReport = "";
+		if (oscServer.start(serverSettings.port, serverReport)){
+			engine.commands = &oscServer.commands();
+		}
+		std::cout << serverReport << std::endl;
+	}
+
+	// Shared memory tap : the master, for the processes next to the synth
+	tapReport = "off, run with --tap";
+	if (tapSettings.enabled){
+		tapReport = "";
+		engine.tap.open(tapSettings.name, 2, sampleRate, bufferSize, tapSettings.numSlots, tapReport);
+		std::cout << tapReport << std::endl;
+	}
+
+	// Scopes : histories written by the engine, meshes rebuilt by draw()
+	scopeMins.assign(scopeWidth, 0.0);
+	scopeMaxs.assign(scopeWidth, 0.0);
+	drawnGeneration = 0;
+	for (auto mesh : {&lMesh, &rMesh, &lFilteredMesh, &rFilteredMesh}){
+		mesh->setMode(OF_PRIMITIVE_LINE_STRIP);
+		mesh->setUsage(GL_DYNAMIC_DRAW);
+	}
+
+	// Spectrogram : analysed by its own thread, draw() only uploads the new
+	// columns; there is nothing to look at without a window
+	spectrogramCursor = 0;
+	spectrogramColumn = 0;
+	if (!serverSettings.headless){
+		const Spectrogram& spectrogram = engine.spectrogram;
+		spectrogramFrames.assign(Spectrogram::historyFrames * spectrogram.frameBytes(), 0);
+		spectrogramTexture.allocate(Spectrogram::historyFrames, spectrogram.numBands(), GL_RGB8);
+		spectrogramTexture.loadData(spectrogramFrames.data(), Spectrogram::historyFrames, spectrogram.numBands(), GL_RGB);
+		engine.spectrogram.start();
+		std::cout << "Spectrogram of " << spectrogramSettings.fftSize << " points every " << spectrogramSettings.hop
+			<< " frames, " << spectrogram.numBands() << " bands" << std::endl;
+	}
+
+	//----------------------------------- granular voice
+	buttonX_grain = 830;
+	buttonY_grain = 80;
+	buttonWidth_grain = 150;
+	buttonPressed_grain = false;
+
+	// all the audio buffers and pools are allocated and zero filled by now,
+	// locking the current mappings keeps them resident
+	if (realtimeSettings.enabled){
+		if (realtimeSettings.lockMemory){
+			lockMemory(realtimeReport);
+		}
+		// the worker threads are already running, each one is pinned so
+		// that none of them lands on the cores of the audio thread
+		realtimeReport += "GUI thread: ";
+		pinThread(currentThread(), realtimeSettings.workerCpus, realtimeReport);
+		realtimeReport += "patch loader: ";
+		pinThread(engine.patches.thread(), realtimeSettings.workerCpus, realtimeReport);
+		if (oscServer.isRunning()){
+			realtimeReport += "OSC server: ";
+			pinThread(oscServer.thread(), realtimeSettings.workerCpus, realtimeReport);
+		}
+		if (engine.spectrogram.isRunning()){
+			realtimeReport += "spectrogram: ";
+			pinThread(engine.spectrogram.thread(), realtimeSettings.workerCpus, realtimeReport);
+		}
+	}
+
+	// JACK calls renderBlock as soon as the client is active, so only once
+	// everything above is ready
+	if (jack.isOpen()){
+		jack.start(audioBackendReport);
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+	// the JACK thread must not outlive the engine
+	jack.close();
+	oscServer.stop();
+	engine.close();
 }
 
 
 //--------------------------------------------------------------
 void ofApp::update(){
+	// free the sample buffers and the patches the audio thread has swapped out
+	engine.granular.collectGarbage();
+	engine.patches.collectGarbage();
+
+	// patches and commands change the shape and the granular voice, the
+	// buttons follow
+	if (engine.mWaveShape != shownWaveShape){
+		shownWaveShape = engine.mWaveShape;
+		buttonPressed = WaveEnabled = (shownWaveShape == WaveShape::Square);
+		buttonPressed_saw = sawWaveEnabled = (shownWaveShape == WaveShape::Saw);
+	}
+	buttonPressed_grain = engine.granularEnabled;
+
+	// the audio thread is only known once it has called audioOut
+	if (realtimeSettings.enabled && !realtimeApplied && engine.audioThreadKnown.load(std::memory_order_acquire)){
+		applyRealtimeSettings();
+	}
 
+	if (oscServer.isRunning()){
+		updateServerReport();
+	}
 }
 
 //--------------------------------------------------------------
-std::vector<std::complex<float>> compute_dft(std::vector<std::complex<float>> dftAudio, std::vector<float> audio){
-	int size_sample = audio.size();
-	std::complex<float> omega = std::exp(std::complex<float>(0, - 2. * M_PI / size_sample));
-	int i = 0;
-	std::complex<float> omega_i(1.0,0.0);
-	int k = 0;
-	std::complex<float> omega_i_k(1.0,0.0);
-	for(auto &v : dftAudio){
-		v = std::complex<float>(0., 0.);
-		omega_i_k = std::complex<float>(1.0,0.0);
-		for (auto &u : audio){
-			v += u * omega_i_k;
-			k++;
-			omega_i_k *= omega_i;
-		}
-		v /= std::sqrt(size_sample);
-		i++;
-		omega_i *= omega;
+void ofApp::updateServerReport(){
+	// once per second, printed when there is no window to show it
+	float now = ofGetElapsedTimef();
+	if (now - serverPreviousTime < 1.f){
+		return;
 	}
-
-	return dftAudio;
+	uint64_t received = oscServer.received();
+	float rate = (received - serverPreviousReceived) / (now - serverPreviousTime);
+	int64_t latency = engine.commandLatencyNs.exchange(0, std::memory_order_relaxed);
+	serverReport = "port "+ofToString(serverSettings.port)+", "+ofToString(rate, 0)+" messages/s, "
+		+ofToString(oscServer.dropped())+" dropped, "+ofToString(oscServer.malformed())+" malformed, worst latency "
+		+ofToString(latency / 1e6, 2)+" ms";
+	if (serverSettings.headless && received != serverPreviousReceived){
+		std::cout << "osc: " << serverReport << std::endl;
+	}
+	serverPreviousReceived = received;
+	serverPreviousTime = now;
 }
 
 //--------------------------------------------------------------
-//--------------------------------------------------------------
-void ofApp::draw(){
-
-ofSetColor(225);
-	ofDrawBitmapString("AUDIO OUTPUT EXAMPLE", 32, 32);
-	ofDrawBitmapString("press 'b' to unpause the audio\npress 'n' to pause the audio", 31, 92);
-	
-	ofNoFill();
-	
-	// draw the left and right channels:
-	ofPushStyle();
-		ofPushMatrix();
-		ofTranslate(32, 150, 0);
-			
-		ofSetColor(225);
-		ofDrawBitmapString("Left Channel", 4, 18);
-		
-		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 450, 200);
+void ofApp::applyRealtimeSettings(){
+	// everything is done from the GUI thread, the audio thread never
+	// waits on a system call for it
+	string report = "audio thread: ";
+	promoteToRealtime(engine.audioThread, realtimeSettings.priority, report);
+	pinThread(engine.audioThread, realtimeSettings.audioCpus, report);
+	realtimeReport += report;
+	realtimeApplied = true;
+	ofLogNotice("realtime") << realtimeReport;
+}
 
-		ofSetColor(58, 135, 245);
-		ofSetLineWidth(3);
-					
-			ofBeginShape();
-			
-			for (unsigned int i = 0; i < lAudio.size(); i++){
-				float x =  ofMap(i, 0, lAudio.size(), 0, 450, true);
-				ofVertex(x, 100 -lAudio[i]*180.0f);
-			}
-			ofEndShape(false);
-			
-		ofPopMatrix();
+//--------------------------------------------------------------
+bool ofApp::updateScopeMeshes(){
+	// a history written meanwhile is torn, try again at the next frame
+	if (!engine.lScope.snapshot(lScopeSnapshot) || !engine.rScope.snapshot(rScopeSnapshot)
+		|| !engine.lFilteredScope.snapshot(lFilteredScopeSnapshot) || !engine.rFilteredScope.snapshot(rFilteredScopeSnapshot)){
+		return false;
+	}
+	buildScopeMesh(lMesh, lScopeSnapshot);
+	buildScopeMesh(rMesh, rScopeSnapshot);
+	buildScopeMesh(lFilteredMesh, lFilteredScopeSnapshot);
+	buildScopeMesh(rFilteredMesh, rFilteredScopeSnapshot);
+	return true;
+}
 
-		ofPushMatrix();
-		ofTranslate(32, 150, 0);
-		ofTranslate(450,0,0);
-			
-		ofSetColor(225);
-		ofDrawBitmapString("Right Channel", 4, 18);
-		
-		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 450, 200);
+//--------------------------------------------------------------
+void ofApp::buildScopeMesh(ofVboMesh& mesh, const vector<float>& history){
+	// one (min, max) column per pixel, joined as a single line strip
+	decimateMinMax(history.data(), history.size(), scopeWidth, scopeMins.data(), scopeMaxs.data());
+	auto& vertices = mesh.getVertices();
+	vertices.resize(2 * scopeWidth);
+	for (size_t c = 0; c < scopeWidth; c++){
+		vertices[2 * c] = glm::vec3(c, 100 - scopeMins[c] * 180.0f, 0);
+		vertices[2 * c + 1] = glm::vec3(c, 100 - scopeMaxs[c] * 180.0f, 0);
+	}
+}
 
-		ofSetColor(245, 58, 135);
-		ofSetLineWidth(3);
-					
-			ofBeginShape();
-			
-			for (unsigned int i = 0; i < rAudio.size(); i++){
-				float x =  ofMap(i, 0, rAudio.size(), 0, 450, true);
-				ofVertex(x, 100 -rAudio[i]*180.0f);
-			}
-			ofEndShape(false);
-			
-		ofPopMatrix();
-	ofPopStyle();
+//--------------------------------------------------------------
+void ofApp::updateSpectrogram(){
+	// the frames computed since the last call, already colour mapped: each
+	// one goes to its column of the texture, the others are left as they are
+	const size_t numBands = engine.spectrogram.numBands();
+	size_t count = engine.spectrogram.read(spectrogramCursor, spectrogramFrames.data(), Spectrogram::historyFrames);
+	if (count == 0){
+		return;
+	}
+	const ofTextureData& texture = spectrogramTexture.getTextureData();
+	glBindTexture(texture.textureTarget, texture.textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t f = 0; f < count; f++){
+		glTexSubImage2D(texture.textureTarget, 0, spectrogramColumn, 0, 1, numBands, GL_RGB, GL_UNSIGNED_BYTE,
+			spectrogramFrames.data() + f * engine.spectrogram.frameBytes());
+		spectrogramColumn = (spectrogramColumn + 1) % Spectrogram::historyFrames;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(texture.textureTarget, 0);
+}
 
-	// draw the left and right filtered signals:
+//--------------------------------------------------------------
+void ofApp::drawSpectrogram(float x, float y, float width, float height){
+	// the oldest column is spectrogramColumn: the texture is drawn in two
+	// parts so that the newest frame is always on the right
+	const float columns = Spectrogram::historyFrames;
+	const float rows = engine.spectrogram.numBands();
+	const float split = width * (columns - spectrogramColumn) / columns;
 	ofPushStyle();
-		ofPushMatrix();
-		ofTranslate(32, 350, 0);
-			
-		ofSetColor(225);
-		string info = "Left filtered at frequency " + ofToString(lowFrequency) + " with quality " + ofToString(lowQ,2); 
-		ofDrawBitmapString(info, 4, 18);
-		
-		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 450, 200);
-
-		ofSetColor(58, 135, 245);
-		ofSetLineWidth(3);
-					
-			ofBeginShape();
-			
-			for (unsigned int i = 0; i < lAudioFiltered.size(); i++){
-				float x =  ofMap(i, 0, lAudioFiltered.size(), 0, 450, true);
-				ofVertex(x, 100 -lAudioFiltered[i]*180.0f);
-			}
-			ofEndShape(false);
-			
-		ofPopMatrix();
+		ofSetColor(255);
+		spectrogramTexture.drawSubsection(x, y, split, height, spectrogramColumn, 0, columns - spectrogramColumn, rows);
+		if (spectrogramColumn > 0){
+			spectrogramTexture.drawSubsection(x + split, y, width - split, height, 0, 0, spectrogramColumn, rows);
+		}
 
-		ofPushMatrix();
-		ofTranslate(32, 350, 0);
-		ofTranslate(450,0,0);
-			
+		// octave marks
 		ofSetColor(225);
-		ofDrawBitmapString("Right filtered", 4, 18);
-		
-		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 450, 200);
-
-		ofSetColor(245, 58, 135);
-		ofSetLineWidth(3);
-					
-			ofBeginShape();
-			
-			for (unsigned int i = 0; i < rAudioFiltered.size(); i++){
-				float x =  ofMap(i, 0, rAudioFiltered.size(), 0, 450, true);
-				ofVertex(x, 100 -rAudioFiltered[i]*180.0f);
+		for (float frequency = 125.f; frequency < 0.5f * sampleRate; frequency *= 4.f){
+			float position = log(frequency / engine.spectrogramSettings.minFrequency) / log(0.5f * sampleRate / engine.spectrogramSettings.minFrequency);
+			if (position > 0.f){
+				ofDrawBitmapString(ofToString(frequency, 0), x + 4, y + height * (1.f - position));
 			}
-			ofEndShape(false);
-			
-		ofPopMatrix();
+		}
+		ofNoFill();
+		ofDrawRectangle(x, y, width, height);
+		ofDrawBitmapString("Spectrogram of the master, " + ofToString(columns / engine.spectrogram.framesPerSecond(), 1) + " s", x + 4, y + 18);
 	ofPopStyle();
+}
 
-	// draw the DFT:
+//--------------------------------------------------------------
+void ofApp::drawScope(const ofVboMesh& mesh, const string& title, float x, float y, bool left){
 	ofPushStyle();
 		ofPushMatrix();
-		ofTranslate(32, 550, 0);
+		ofTranslate(x, y, 0);
 			
 		ofSetColor(225);
-		ofDrawBitmapString("DFT Right : Red", 4, 18);
+		ofDrawBitmapString(title, 4, 18);
 		
 		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 900, 200);
+		ofDrawRectangle(0, 0, scopeWidth, 200);
 
-		ofSetColor(245, 58, 135);
-		ofSetLineWidth(3);
-		ofTranslate(0, 200, 0);
-		float maxDft = 0.0;
-		for(size_t i=0; i < dftAudio.size(); i++){
-			dftAudioNorm[i] = std::norm(dftAudio[i]);
-			maxDft = (dftAudioNorm[i] > maxDft) ? dftAudioNorm[i] : maxDft;
+		if (left){
+			ofSetColor(58, 135, 245);
+		} else {
+			ofSetColor(245, 58, 135);
 		}
-		dftAudio = compute_dft(dftAudio, rAudio);
-			ofBeginShape();
-			for (unsigned int i = 0; i < dftAudio.size() / 2; i++){ // Display only half of the DFT
-				// float freq = ofMap(i, 0, dftAudio.size() / 2, 2, 2000); // Map index to frequency range
-				// float x =  ofMap(freq, 2, 2000, 0, 900, true); // Map frequency to x-axis
-				float x =  ofMap(i, 0, dftAudio.size() / 2, 0, 900, true);
-				float y = ofMap(std::norm(dftAudio[i]), 0, maxDft, 0, 200, true);
-				ofVertex(x, -y);
-			}
-			// ofBeginShape();
-			// for (unsigned int i = 0; i < dftAudio.size(); i++){
-			// 	float x =  ofMap(i, 0, dftAudio.size(), 0, 900, true);
-			// 	// ofVertex(x, 100 -std::norm(dftAudio[i])*180.0f);
-			// 	ofDrawLine(x, float(0.), x, -y);
-			// }
-			// ofEndShape(false);
-			ofEndShape(false);
+		ofSetLineWidth(3);
+		mesh.draw();
 			
 		ofPopMatrix();
 	ofPopStyle();
+}
 
-	ofPushStyle();
-		ofPushMatrix();
-		ofTranslate(32, 550, 0);
-			
-		ofSetColor(225);
-		ofDrawBitmapString("\nDFT Left : Blue", 4, 18);
-		
-		ofSetLineWidth(1);	
-		ofDrawRectangle(0, 0, 900, 200);
+//--------------------------------------------------------------
+//--------------------------------------------------------------
+void ofApp::draw(){
+	// nothing to draw on without a window
+	if (serverSettings.headless){
+		return;
+	}
 
-		ofSetColor(58, 135, 245); // Change colour to blue
-		ofSetLineWidth(3);
+ofSetColor(225);
+	ofDrawBitmapString("AUDIO OUTPUT EXAMPLE", 32, 32);
+	ofDrawBitmapString("press 'b' to unpause the audio\npress 'n' to pause the audio", 31, 92);
+	
+	ofNoFill();
+	
+	// rebuild the scope geometry only when a new audio block
+	// has arrived, while the audio is paused only the cached meshes are drawn
+	uint64_t generation = engine.rFilteredScope.generation();
+	if (generation != drawnGeneration && updateScopeMeshes()){
+		drawnGeneration = generation;
+	}
 
-		ofTranslate(0, 200, 0);
-		dftAudio = compute_dft(dftAudio, rAudio);
-		maxDft = 0.0;
-		for(size_t i=0; i < dftAudio.size(); i++){
-			dftAudioNorm[i] = std::norm(dftAudio[i]);
-			maxDft = (dftAudioNorm[i] > maxDft) ? dftAudioNorm[i] : maxDft;
-		}
-			ofBeginShape();
-			for (unsigned int i = 0; i < dftAudio.size() / 2; i++){ // Display only half of the DFT
-				// float freq = ofMap(i, 0, dftAudio.size() / 2, 2, 2000); // Map index to frequency range
-				// float x =  ofMap(freq, 2, 2000, 0, 900, true); // Map frequency to x-axis
-				float x =  ofMap(i, 0, dftAudio.size() / 2, 0, 900, true);
-				float y = ofMap(std::norm(dftAudio[i]), 0, maxDft, 0, 200, true);
-				ofVertex(x, -y);
-			}
-			ofEndShape(false);
-			
-		ofPopMatrix();
-	ofPopStyle();
+	// draw the left and right channels:
+	drawScope(lMesh, "Left Channel", 32, 150, true);
+	drawScope(rMesh, "Right Channel", 32 + scopeWidth, 150, false);
+
+	// draw the left and right filtered signals:
+	string info = "Left filtered at frequency " + ofToString(engine.lowFrequency) + " with quality " + ofToString(engine.lowQ,2); 
+	drawScope(lFilteredMesh, info, 32, 350, true);
+	drawScope(rFilteredMesh, "Right filtered", 32 + scopeWidth, 350, false);
+
+	// draw the spectrogram:
+	if (spectrogramTexture.isAllocated()){
+		updateSpectrogram();
+		drawSpectrogram(32, 550, 900, 200);
+	}
 	
 	// Add a comment line with current values of variables :	
 	ofSetColor(225);
 	// Volume and pan : 
-	string reportString = "volume: ("+ofToString(volume, 2)+") modify with -/+ keys\npan: ("+ofToString(pan, 2)+")\nsynthesis: ";
+	string reportString = "volume: ("+ofToString(engine.volume, 2)+") modify with -/+ keys\npan: ("+ofToString(pan, 2)+")\nsynthesis: ";
 	// Current frequency :
 	reportString += "sine wave (" + ofToString(targetFrequency, 2) + "hz)";
 	// Current octave : 
-	reportString += "\noctave: "+ofToString(octaveIndex, 2)+", modify with w/x keys";
+	reportString += "\noctave: "+ofToString(engine.octaveIndex, 2)+", modify with w/x keys";
 	// reportString+= "\ncurrent note"+ofToString(mNote, 2);
 	// Current brillance : 
-	reportString += "\nBrillance: "+ofToString(mBrillance, 2)+", modify with c(-)/v(+) keys (not less than 1)";
-	ofDrawBitmapString(reportString, 32, 779);
+	reportString += "\nBrillance: "+ofToString(engine.mBrillance, 2)+", modify with c(-)/v(+) keys (not less than 1)";
+	// Oversampling :
+	reportString += "\noversampling: "+ofToString(engine.oversamplingFactor)+"x, modify with r key";
+	// Limiter :
+	reportString += "\nlimiter: "+ofToString(20.f * log10(engine.limiter.gainReduction()), 1)+" dB, lookahead "+ofToString(engine.limiter.lookaheadMs, 1)
+		+"ms, true peak "+(engine.limiter.truePeak ? "on" : "off")+", modify with m key";
+	// Audio backend :
+	reportString += "\naudio: "+audioBackendReport;
+	if (jack.isShutdown()){
+		reportString += " JACK server gone, restart the app.";
+	} else if (jack.isOpen() && jack.sampleRateMismatch()){
+		reportString += " JACK sample rate is now "+ofToString(jack.sampleRate())+" Hz, restart the app.";
+	}
+	// Patches :
+	reportString += "\npatch: "+(engine.patches.current() >= 0 ? ofToString(engine.patches.current()) : string("none"))+" of "
+		+ofToString(engine.patches.bankSize())+", load with 0-9, store with F1-F10 "+patchReport;
+	// Headless server :
+	reportString += "\nosc: "+serverReport;
+	// Shared memory tap :
+	reportString += "\ntap: "+tapReport;
+	// Modulation matrix :
+	string routes;
+	const s_modulation_settings& modulationSettings = engine.modulation.settings();
+	for (const auto& route : modulationSettings.routes){
+		if (route.depth != 0.f){
+			const s_modulator_settings& modulator = modulationSettings.modulators[route.source];
+			routes += (routes.empty() ? "" : ", ") + ofToString(route.source) + " " + modShapeName(modulator.shape)
+				+ (modulator.shape == ModShape::Envelope ? "" : " " + ofToString(modulator.rate, 1) + "Hz")
+				+ " > " + modTargetName(route.target) + " " + ofToString(route.depth, 2);
+		}
+	}
+	reportString += "\nmodulation: "+(routes.empty() ? string("none, set with /mod/lfo, /mod/env and /mod/route") : routes);
+	// Quality governor :
+	reportString += "\nquality: "+string(QualityGovernor::name(engine.governor.tier()))+", steps down above "
+		+ofToString(100.f * engine.governor.degradeLoad, 0)+"% load";
+	// Realtime mode and dropouts :
+	reportString += "\nrealtime: "+realtimeReport+"\ndropouts: "+ofToString(engine.dropouts.lateCallbacks())+" late callbacks, "
+		+ofToString(engine.dropouts.overruns())+" overruns, load "+ofToString(100.f * engine.dropouts.load(), 0)+"%";
+	// Granular voice :
+	if (engine.granularEnabled){
+		reportString += "\ngranular (" + string(engine.granular.isLive() ? "oscillators" : "sample") + "): "
+			+ ofToString(engine.granular.activeGrains()) + " grains, density " + ofToString(engine.granular.density, 0) + "/s k/l, size "
+			+ ofToString(engine.granular.grainSize * 1000.f, 1) + "ms i/o, jitter " + ofToString(engine.granular.pitchJitter, 2) + " a/p, position drag";
+	}
+	// in a column of its own, right of the scopes : main.cpp sizes the
+	// window for its longest lines
+	ofDrawBitmapString(reportString, 32 + 2 * scopeWidth + 32, 162);
 
 	// 	ofSetColor(225);
 	// string reportString = "volume: ("+ofToString(volume, 2)+") modify with -/+ keys\npan: ("+ofToString(pan, 2)+") modify with mouse x\nsynthesis: ";
@@ -545,11 +516,51 @@ ofSetColor(225);
 	float textY_saw = buttonY_saw + (buttonHeight + 10) / 2; // Adjust 10 as needed for proper positioning
 	// Draw text for SAW button
 	ofDrawBitmapString("SAW", textX_saw, textY_saw);
-}
 
-//--------------------------------------------------------------
-float ofApp::pitchToFrequency(int pitch, float A4frequency = 440.f, int A4pitch = 57){
-	return A4frequency * pow(2, ((pitch - A4pitch) / 12.f));
+	// Draw the third button (for the granular voice)
+	if (buttonPressed_grain) {
+		ofSetColor(0, 255, 0); // green when pressed
+	} else {
+		ofSetColor(255, 0, 0); // red otherwise
+	}
+	ofDrawRectangle(buttonX_grain, buttonY_grain, buttonWidth_grain, buttonHeight);
+	ofSetColor(255);
+	float textX_grain = buttonX_grain + (buttonWidth_grain - 60) / 2;
+	float textY_grain = buttonY_grain + (buttonHeight + 10) / 2;
+	ofDrawBitmapString("GRAIN", textX_grain, textY_grain);
+
+	// Draw the tuner : level bar, octave and deviation in cents of every note
+	static const char* noteNames[numNotes] = {"C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B"};
+	// a block published during the copy tears it, the last readouts stay
+	s_note_readout readouts[numNotes];
+	if (engine.tuner.readouts(readouts)){
+		std::copy(readouts, readouts + numNotes, tunerReadouts);
+	}
+	ofPushStyle();
+		ofPushMatrix();
+		ofTranslate(32, 770, 0);
+		for (int note = 0; note < numNotes; note++){
+			const s_note_readout& readout = tunerReadouts[note];
+			float x = note * 75;
+			float level = ofMap(20.f * log10(readout.level + 1e-6f), -60, 0, 0, 40, true);
+			ofNoFill();
+			ofSetColor(225);
+			ofDrawRectangle(x, 0, 70, 40);
+			ofFill();
+			if (readout.sounding){
+				ofSetColor(58, 245, 135);
+			} else {
+				ofSetColor(90);
+			}
+			ofDrawRectangle(x, 40 - level, 8, level);
+			ofSetColor(225);
+			ofDrawBitmapString(string(noteNames[note]) + ofToString(readout.octave), x + 14, 16);
+			if (readout.sounding){
+				ofDrawBitmapString((readout.cents >= 0 ? "+" : "") + ofToString(readout.cents, 0) + "c", x + 14, 34);
+			}
+		}
+		ofPopMatrix();
+	ofPopStyle();
 }
 
 //--------------------------------------------------------------
@@ -559,39 +570,92 @@ void ofApp::keyPressed  (int key){
 
 	// volume : 
 	if (key == '-' || key == '_' ){
-		volume -= 0.05;
-		volume = MAX(volume, 0);
+		engine.volume -= 0.05;
+		engine.volume = MAX(engine.volume, 0);
 	} else if (key == '+' || key == '=' ){
-		volume += 0.05;
-		volume = MIN(volume, 1);
+		engine.volume += 0.05;
+		engine.volume = MIN(engine.volume, 1);
 	}
 	// start and stop sound : 
 	if( key == 'b' ){
-		soundStream.start();
+		engine.dropouts.restart();
+		if (jack.isOpen()){
+			jack.start(audioBackendReport);
+		} else {
+			soundStream.start();
+		}
 	}
 	if( key == 'n' ){
-			soundStream.stop();
+			if (jack.isOpen()){
+				jack.stop();
+			} else {
+				soundStream.stop();
+			}
 		}
 
 	// change brillance : c/v
 	if (key=='c'){
-		mBrillance-=1;
-		if (mBrillance<=0){
-			mBrillance=1;
+		engine.mBrillance-=1;
+		if (engine.mBrillance<=0){
+			engine.mBrillance=1;
 		}
 	}
 	if (key=='v'){
-		mBrillance+=1;
+		engine.mBrillance+=1;
+	}
+
+	// patches : 0-9 load, F1-F10 store the current settings in 0-9
+	if (key >= '0' && key <= '9'){
+		engine.patches.request(key - '0');
+	}
+	if (key >= OF_KEY_F1 && key <= OF_KEY_F10){
+		patchReport = "";
+		engine.patches.store(key - OF_KEY_F1, engine.currentPatch(), patchReport);
+	}
+
+	// oversampling : r cycles through 1x, 2x, 4x and 8x
+	if (key=='r'){
+		engine.oversamplingFactor = (engine.oversamplingFactor >= Oversampler::maxFactor) ? 1 : engine.oversamplingFactor * 2;
+	}
+
+	// limiter : m toggles the true peak detection
+	if (key=='m'){
+		engine.limiter.truePeak = !engine.limiter.truePeak;
+	}
+
+	// granular voice : density k/l, grain size i/o, pitch jitter a/p
+	switch (key)
+	{
+	case 'k':
+		engine.granular.density = MAX(engine.granular.density / 1.5f, 1.f);
+		break;
+	case 'l':
+		engine.granular.density = MIN(engine.granular.density * 1.5f, 20000.f);
+		break;
+	case 'i':
+		engine.granular.grainSize = MAX(engine.granular.grainSize / 1.25f, 0.002f);
+		break;
+	case 'o':
+		engine.granular.grainSize = MIN(engine.granular.grainSize * 1.25f, 0.5f);
+		break;
+	case 'a':
+		engine.granular.pitchJitter = MAX(engine.granular.pitchJitter - 0.1f, 0.f);
+		break;
+	case 'p':
+		engine.granular.pitchJitter = MIN(engine.granular.pitchJitter + 0.1f, 12.f);
+		break;
+	default:
+		break;
 	}
 
 	// keyboard notes : 
 	switch (key)
 	{
 	case 'w':
-		octaveIndex=octaveIndex-1;
+		engine.octaveIndex=std::max(engine.octaveIndex-1, minOctave);
 		break;
 	case 'x':
-		octaveIndex=octaveIndex+1;
+		engine.octaveIndex=std::min(engine.octaveIndex+1, maxOctave);
 		break;
 	default:
 		break;
@@ -601,87 +665,87 @@ void ofApp::keyPressed  (int key){
 		{
 		case 'q':
 			mNote=Notes::C;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'z':
 			mNote=Notes::Db;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 's':
 			mNote=Notes::D;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'e':
 			mNote=Notes::Eb;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'd':
 			mNote=Notes::E;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'f':
 			mNote=Notes::F;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 't':
 			mNote=Notes::Gb;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'g':
 			mNote=Notes::G;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'y':
 			mNote=Notes::Ab;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'h':
 			mNote=Notes::A;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'u':
 			mNote=Notes::Bb;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		case 'j':
 			mNote=Notes::B;
-			signalsNotes[static_cast<int>(mNote)].volume = volume;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = engine.volume;
 			pitchIndex = static_cast<int>(mNote);
-			pitch = pitchIndex+octaveIndex*12;
-			signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
+			pitch = pitchIndex+engine.octaveIndex*12;
+			engine.signalsNotes[static_cast<int>(mNote)].frequency = pitchToFrequency(pitch);
 			break;
 		default:
 			break;
@@ -703,56 +767,56 @@ void ofApp::keyReleased  (int key){
 		{
 		case 'q':
 			mNote=Notes::C;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'z':
 			mNote=Notes::Db;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 's':
 			mNote=Notes::D;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'e':
 			mNote=Notes::Eb;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'd':
 			mNote=Notes::E;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'f':
 			mNote=Notes::F;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 't':
 			mNote=Notes::Gb;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'g':
 			mNote=Notes::G;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'y':
 			mNote=Notes::Ab;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'h':
 			mNote=Notes::A;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'u':
 			mNote=Notes::Bb;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		case 'j':
 			mNote=Notes::B;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		default:
 			// compilation error: jump to default:
 			mNote=Notes::A;
-			signalsNotes[static_cast<int>(mNote)].volume = 0.0;
+			engine.signalsNotes[static_cast<int>(mNote)].volume = 0.0;
 			break;
 		}
 }
@@ -764,15 +828,16 @@ void ofApp::mouseMoved(int x, int y ){
 	float widthPct = ((float)x)/ ((float)width); 
 	float height = (float)ofGetHeight();
 	float heightPct = ((height-y) / height);
-	lowFrequency = 20000 * heightPct;
-	lowQ = 0.01 + 0.99 * widthPct;
-	lowFilter = lowPassFilter(lowFrequency, lowQ);
+	engine.lowFrequency = 20000 * heightPct;
+	engine.lowQ = 0.01 + 0.99 * widthPct;
+	engine.lowFilter = engine.lowPassFilter(engine.lowFrequency, engine.lowQ);
 }
 
 //--------------------------------------------------------------
 void ofApp::mouseDragged(int x, int y, int button){
 	// int width = ofGetWidth();
 	// pan = (float)x / (float)width;
+	engine.granular.position = ofClamp((float)x / (float)ofGetWidth(), 0.f, 1.f);
 }
 
 //--------------------------------------------------------------
@@ -791,13 +856,18 @@ void ofApp::mousePressed(int x, int y, int button){
         buttonPressed_saw = !buttonPressed_saw; // Toggle the button state
         sawWaveEnabled = !sawWaveEnabled; // Toggle the SAW waveform state
     }
+	if (x > buttonX_grain && x < buttonX_grain + buttonWidth_grain && y > buttonY_grain && y < buttonY_grain + buttonHeight) {
+		buttonPressed_grain = !buttonPressed_grain;
+		engine.granularEnabled = !engine.granularEnabled;
+	}
 	if (WaveEnabled) {
-		mWaveShape = WaveShape::Square;
+		engine.mWaveShape = WaveShape::Square;
 	} else if (sawWaveEnabled) {
-		mWaveShape = WaveShape::Saw;
+		engine.mWaveShape = WaveShape::Saw;
 	} else {
-		mWaveShape = WaveShape::Sin;
+		engine.mWaveShape = WaveShape::Sin;
 	}
+	shownWaveShape = engine.mWaveShape;
 
 }
 
@@ -829,42 +899,8 @@ void ofApp::windowResized(int w, int h){
 
 //--------------------------------------------------------------
 void ofApp::audioOut(ofSoundBuffer & buffer){
-	initSignal();
-	
-	// change signal calculation according to 'mWaveShape', Sin by default
-	for(auto& signal : signals ){
-		switch (mWaveShape){
-			case WaveShape::Sin:
-				addSignal_sin(signal);
-				break;
-			case WaveShape::Saw:
-				addSignal_saw(signal);
-				break;
-			case WaveShape::Square:
-				addSignal_square(signal);
-				break;
-			default:
-				addSignal_sin(signal);
-				break;
-		}
-	}
-	for(auto& signal: signalsNotes){
-		switch (mWaveShape){
-			case WaveShape::Sin:
-				addSignal_sin(signal);
-				break;
-			case WaveShape::Saw:
-				addSignal_saw(signal);
-				break;
-			case WaveShape::Square:
-				addSignal_square(signal);
-				break;
-			default:
-				addSignal_sin(signal);
-				break;
-		}
-	}
-	applyFilter(lowFilter);
+	float* outputs[2] = {lAudioFiltered.data(), rAudioFiltered.data()};
+	engine.renderBlock(outputs, 2, buffer.getNumFrames());
 
 	for (size_t i = 0; i < buffer.getNumFrames(); i++){
 		buffer[i*buffer.getNumChannels()    ] = lAudioFiltered[i]; // = sample * volume * leftScale;
@@ -879,5 +915,15 @@ void ofApp::gotMessage(ofMessage msg){
 
 //--------------------------------------------------------------
 void ofApp::dragEvent(ofDragInfo dragInfo){ 
-
+	// dropping a .wav file makes it the source of the granular voice
+	for (auto& file : dragInfo.files){
+		std::vector<float> sample;
+		size_t sampleRateFile = sampleRate;
+		if (loadWavMono(file, sample, sampleRateFile)){
+			engine.granular.setSample(sample, sampleRateFile);
+			std::cout << "granular source: " << file << " (" << sample.size() << " samples)" << std::endl;
+			return;
+		}
+	}
+	engine.granular.useLiveSource();
 }
@@ -1,52 +1,13 @@
 #include "ofMain.h"
-#include <complex>
-
-typedef struct{
-	float phase;
-	float frequency;
-	float volume;
-} s_signal;
-
-typedef struct{
-	float x_1;
-	float x_2;
-	float y_1;
-	float y_2;
-} s_previous_values;
-
-typedef struct{
-	float b_0;
-	float b_1;
-	float b_2;
-	float a_1;
-	float a_2;
-} s_filter;
-
-enum class Notes
-{
-	C,
-	Db,
-	D,
-	Eb,
-	E,
-	F,
-	Gb,
-	G,
-	Ab,
-	A,
-	Bb,
-	B, 
-	sizeNotes,
-	No_sound,
-};
-
-enum class WaveShape
-{	
-	Sin,
-	Square,
-	Saw,
-};
-
+#include "engine.h"
+#include "jack_backend.h"
+#include "osc_server.h"
+#include "realtime.h"
+#include "shared_tap.h"
+#include "spectrogram.h"
+
+// Window, keyboard and mouse over the engine, see engine.h. The audio
+// backends call engine.renderBlock() directly.
 class ofApp : public ofBaseApp{
 
 	public:
@@ -54,6 +15,7 @@ class ofApp : public ofBaseApp{
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed  (int key);
 		void keyReleased(int key);
@@ -68,21 +30,22 @@ class ofApp : public ofBaseApp{
 		void gotMessage(ofMessage msg);
 		
 		void audioOut(ofSoundBuffer & buffer);
+
+		SynthEngine engine;
 		
 		ofSoundStream soundStream;
 
+		// JACK instead of ofSoundStream when run with --jack, see jack_backend.h
+		s_jack_settings jackSettings;
+		JackBackend jack;
+		string audioBackendReport;
+
 		float 	pan;
 		// int	sampleRate;
 		bool 	bNoise;
-		float 	volume;
-
-		vector <float> lAudio;
-		vector <float> rAudio;
 
 		vector<float> lAudioFiltered;
 		vector<float> rAudioFiltered;
-		s_previous_values lAudioPreviousValues;
-		s_previous_values rAudioPreviousValues;
 
 		ofSoundBuffer buffer;
 		
@@ -92,36 +55,12 @@ class ofApp : public ofBaseApp{
 		float 	phaseAdder;
 		float 	phaseAdderTarget;
 
-		void addSignal_sin(s_signal& signal);
-		void addSignal_saw(s_signal& signal);
-		void addSignal_square(s_signal& signal);
-		void initSignal();
-		void synthesizeSquaredSignal(float frequency, int brillance);
-		void synthesizeSawToothSignal(float frequency, int brillance);
 		size_t bufferSize;
 		size_t sampleRate;
-		vector <std::complex<float>> dftAudio;
-		vector<float> dftAudioNorm;
-		vector<s_signal> signals;
-
 
-		float 	pitchToFrequency(int pitch, float A4frequency, int A4pitch);
 		Notes 	mNote;
-		int 	octaveIndex;
-
-		int 	mBrillance;
-		static constexpr int numNotes = static_cast<int>(Notes::sizeNotes);
-		s_signal signalsNotes[numNotes-1];
-
-		float lowFrequency;
-		float highFrequency;
-		float lowQ;
-		float highQ;
-		s_filter lowFilter;
-		s_filter highFilter;
-		s_filter lowPassFilter(float frequency, float Q);
-		s_filter highPassFilter(float frequency, float Q);
-		void applyFilter(s_filter filter);
+		static constexpr int numNotes = SynthEngine::numNotes;
+
 		//----------------------------------- for the change of the shape of the wave
 
 
@@ -133,5 +72,59 @@ class ofApp : public ofBaseApp{
     	int buttonX_saw, buttonY_saw;
    		bool buttonPressed_saw;
 		bool sawWaveEnabled; // Variable to track the state of the SAW button
-		WaveShape mWaveShape;
-};
\ No newline at end of file
+		WaveShape shownWaveShape;	// the buttons follow the shape set by patches and commands
+
+		//----------------------------------- realtime mode
+		s_realtime_settings realtimeSettings;
+		bool realtimeApplied;
+		string realtimeReport;
+		void applyRealtimeSettings();
+
+		//----------------------------------- headless server, see osc_server.h
+		s_server_settings serverSettings;
+		OscServer oscServer;
+		string serverReport;
+		uint64_t serverPreviousReceived;
+		float serverPreviousTime;
+		void updateServerReport();
+
+		//----------------------------------- patches
+		string patchReport;
+
+		//----------------------------------- shared memory tap
+		s_tap_settings tapSettings;
+		string tapReport;
+
+		//----------------------------------- scopes
+		static constexpr size_t scopeWidth = 450;
+		vector<float> lScopeSnapshot;
+		vector<float> rScopeSnapshot;
+		vector<float> lFilteredScopeSnapshot;
+		vector<float> rFilteredScopeSnapshot;
+		vector<float> scopeMins;
+		vector<float> scopeMaxs;
+		ofVboMesh lMesh;
+		ofVboMesh rMesh;
+		ofVboMesh lFilteredMesh;
+		ofVboMesh rFilteredMesh;
+		uint64_t drawnGeneration;
+		bool updateScopeMeshes();
+		void buildScopeMesh(ofVboMesh& mesh, const vector<float>& history);
+
+		//----------------------------------- tuner
+		s_note_readout tunerReadouts[numNotes] = {};	// kept when a copy is torn
+		void drawScope(const ofVboMesh& mesh, const string& title, float x, float y, bool left);
+
+		//----------------------------------- spectrogram, see spectrogram.h
+		s_spectrogram_settings spectrogramSettings;
+		ofTexture spectrogramTexture;		// one column per frame, oldest at spectrogramColumn
+		vector<uint8_t> spectrogramFrames;	// colour mapped by the analysis thread
+		uint64_t spectrogramCursor;
+		size_t spectrogramColumn;
+		void updateSpectrogram();
+		void drawSpectrogram(float x, float y, float width, float height);
+
+		//----------------------------------- granular voice
+		int buttonX_grain, buttonY_grain, buttonWidth_grain;
+		bool buttonPressed_grain;
+};
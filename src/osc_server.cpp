@@ -0,0 +1,347 @@
+#include "osc_server.h"
+#include "engine.h"
+#include "modulation.h"
+#include "realtime.h"
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------
+s_server_settings parseServerArguments(int argc, char* argv[]){
+	s_server_settings settings;
+	for (int i = 1; i < argc; i++){
+		std::string argument = argv[i];
+		if (argument == "--headless"){
+			settings.headless = true;
+			settings.enabled = true;
+		} else if (argument == "--osc"){
+			settings.enabled = true;
+		} else if (argument.rfind("--osc-port=", 0) == 0){
+			settings.port = atoi(argument.c_str() + strlen("--osc-port="));
+		}
+	}
+	return settings;
+}
+
+//--------------------------------------------------------------
+// OSC strings are null terminated and padded to a multiple of 4 bytes.
+static const char* readOscString(const char* p, const char* end){
+	const char* terminator = static_cast<const char*>(memchr(p, 0, end - p));
+	if (terminator == nullptr){
+		return nullptr;
+	}
+	size_t length = (terminator - p) + 1;
+	return p + ((length + 3) & ~size_t(3));
+}
+
+static uint32_t readBigEndian(const char* p){
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+}
+
+//--------------------------------------------------------------
+// Index of a name among count names, -1 if unknown.
+static int findName(const char* name, const char* (*nameOf)(int), int count){
+	for (int i = 0; i < count; i++){
+		if (strcmp(name, nameOf(i)) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+static const char* waveShapeName(int shape){
+	static const char* shapes[] = {"sin", "square", "saw"};
+	return shapes[shape];
+}
+
+static const char* modShapeNameOf(int shape){
+	return modShapeName(static_cast<ModShape>(shape));
+}
+
+static const char* modTargetNameOf(int target){
+	return modTargetName(static_cast<ModTarget>(target));
+}
+
+//--------------------------------------------------------------
+// The first argument of a message, as an int and as a float whatever its
+// OSC type; the following ones as floats. A string argument is looked up
+// among the names its position expects.
+static bool parseOscMessage(const char* data, size_t size, int64_t receivedNs, s_synth_command& command){
+	const char* end = data + size;
+	const char* address = data;
+	const char* tags = readOscString(address, end);
+	if (tags == nullptr || tags >= end || tags[0] != ','){
+		return false;
+	}
+	const char* arguments = readOscString(tags, end);
+	if (arguments == nullptr || arguments > end){
+		return false;
+	}
+
+	static constexpr int maxArguments = 5;
+	int intValues[maxArguments] = {};
+	float floatValues[maxArguments] = {-1.f, -1.f, -1.f, -1.f, -1.f};
+	const char* stringValues[maxArguments] = {};
+	int numArguments = 0;
+	const char* p = arguments;
+	for (const char* tag = tags + 1; *tag != 0 && numArguments < maxArguments; tag++, numArguments++){
+		if (*tag == 'i' || *tag == 'f'){
+			if (p + 4 > end){
+				return false;
+			}
+			uint32_t bits = readBigEndian(p);
+			if (*tag == 'i'){
+				intValues[numArguments] = int32_t(bits);
+				floatValues[numArguments] = float(int32_t(bits));
+			} else {
+				float value;
+				memcpy(&value, &bits, 4);
+				// no NaN nor infinity gets past here, and int() of a float
+				// outside the int range would be undefined
+				if (!std::isfinite(value) || fabsf(value) >= 2147483648.f){
+					return false;
+				}
+				floatValues[numArguments] = value;
+				intValues[numArguments] = int(value);
+			}
+			p += 4;
+		} else if (*tag == 's'){
+			stringValues[numArguments] = p;
+			p = readOscString(p, end);
+			if (p == nullptr){
+				return false;
+			}
+		} else {
+			return false;
+		}
+	}
+
+	// a name where a number is expected, -1 when unknown
+	auto resolve = [&](int argument, const char* (*nameOf)(int), int count){
+		if (stringValues[argument] != nullptr){
+			intValues[argument] = findName(stringValues[argument], nameOf, count);
+			floatValues[argument] = float(intValues[argument]);
+		}
+		return intValues[argument] >= 0 && intValues[argument] < count;
+	};
+
+	command.receivedNs = receivedNs;
+	command.intValue = intValues[0];
+	command.value = floatValues[0];
+	for (int i = 0; i < 4; i++){
+		command.arguments[i] = floatValues[i + 1];
+	}
+	if (strcmp(address, "/note/on") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::NoteOn;
+		command.value = (numArguments >= 2) ? floatValues[1] : -1.f;
+		if (command.intValue < 0 || command.intValue > maxPitch){
+			return false;
+		}
+	} else if (strcmp(address, "/note/off") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::NoteOff;
+		if (command.intValue < 0 || command.intValue > maxPitch){
+			return false;
+		}
+	} else if (strcmp(address, "/brillance") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::Brillance;
+	} else if (strcmp(address, "/octave") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::Octave;
+		if (command.intValue < minOctave || command.intValue > maxOctave){
+			return false;
+		}
+	} else if (strcmp(address, "/volume") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::Volume;
+	} else if (strcmp(address, "/filter/cutoff") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::FilterCutoff;
+	} else if (strcmp(address, "/filter/q") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::FilterQ;
+	} else if (strcmp(address, "/patch") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::Patch;
+	} else if (strcmp(address, "/waveshape") == 0 && numArguments >= 1){
+		command.type = SynthCommandType::WaveShape;
+		if (!resolve(0, waveShapeName, 3)){
+			return false;
+		}
+		command.intValue = intValues[0];
+	} else if (strcmp(address, "/mod/lfo") == 0 && numArguments >= 3){
+		command.type = SynthCommandType::ModLfo;
+		if (!resolve(1, modShapeNameOf, static_cast<int>(ModShape::sizeShapes))){
+			return false;
+		}
+		command.arguments[0] = float(intValues[1]);
+	} else if (strcmp(address, "/mod/env") == 0 && numArguments >= 5){
+		command.type = SynthCommandType::ModEnvelope;
+	} else if (strcmp(address, "/mod/route") == 0 && numArguments >= 4){
+		command.type = SynthCommandType::ModRoute;
+		if (!resolve(2, modTargetNameOf, static_cast<int>(ModTarget::sizeTargets))){
+			return false;
+		}
+		command.arguments[1] = float(intValues[2]);
+		// the source indexes the modulators in the audio thread
+		if (stringValues[1] != nullptr || intValues[1] < 0 || intValues[1] >= maxModulators){
+			return false;
+		}
+		command.arguments[0] = float(intValues[1]);
+	} else {
+		return false;
+	}
+	// slots and routes are fixed arrays
+	int numSlots = (command.type == SynthCommandType::ModRoute) ? maxModRoutes : maxModulators;
+	if (command.type >= SynthCommandType::ModLfo && (command.intValue < 0 || command.intValue >= numSlots)){
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+int parseOscPacket(const char* data, size_t size, int64_t receivedNs,
+	s_synth_command* commands, size_t maxCommands, size_t& numCommands){
+	if (size < 4 || (size & 3) != 0){
+		return 1;
+	}
+	if (size >= 16 && memcmp(data, "#bundle", 8) == 0){
+		// "#bundle", time tag, then elements prefixed by their size
+		int errors = 0;
+		const char* p = data + 16;
+		const char* end = data + size;
+		while (p + 4 <= end){
+			uint32_t elementSize = readBigEndian(p);
+			p += 4;
+			if (elementSize > size_t(end - p)){
+				return errors + 1;
+			}
+			errors += parseOscPacket(p, elementSize, receivedNs, commands, maxCommands, numCommands);
+			p += elementSize;
+		}
+		return errors;
+	}
+	if (numCommands >= maxCommands){
+		return 1;
+	}
+	if (!parseOscMessage(data, size, receivedNs, commands[numCommands])){
+		return 1;
+	}
+	numCommands++;
+	return 0;
+}
+
+//--------------------------------------------------------------
+OscServer::~OscServer(){
+	stop();
+}
+
+#ifdef __linux__
+//--------------------------------------------------------------
+bool OscServer::start(int port, std::string& report){
+	stop();
+	mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (mSocket < 0){
+		report += "osc: no socket (" + std::string(strerror(errno)) + "). ";
+		return false;
+	}
+	// room for bursts while the thread is descheduled
+	int bufferBytes = 4 << 20;
+	setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(mSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0){
+		report += "osc: cannot listen on 127.0.0.1:" + std::to_string(port) + " (" + std::string(strerror(errno)) + "). ";
+		::close(mSocket);
+		mSocket = -1;
+		return false;
+	}
+	mStop.store(false);
+	mThread = std::thread(&OscServer::run, this);
+	report += "osc: listening on 127.0.0.1:" + std::to_string(port) + ". ";
+	return true;
+}
+
+//--------------------------------------------------------------
+void OscServer::stop(){
+	if (mThread.joinable()){
+		mStop.store(true);
+		mThread.join();
+	}
+	if (mSocket >= 0){
+		::close(mSocket);
+		mSocket = -1;
+	}
+}
+
+//--------------------------------------------------------------
+void OscServer::run(){
+	// several datagrams per system call
+	static constexpr int batch = 64;
+	static constexpr size_t datagramSize = 8192;
+	static constexpr size_t maxCommands = 1024;
+	std::vector<char> buffers(batch * datagramSize);
+	std::vector<s_synth_command> commands(maxCommands);
+	struct iovec vectors[batch];
+	struct mmsghdr messages[batch];
+
+	struct pollfd descriptor;
+	descriptor.fd = mSocket;
+	descriptor.events = POLLIN;
+	while (!mStop.load(std::memory_order_relaxed)){
+		// wake up regularly to notice stop()
+		if (poll(&descriptor, 1, 100) <= 0){
+			continue;
+		}
+		for (int i = 0; i < batch; i++){
+			vectors[i].iov_base = buffers.data() + i * datagramSize;
+			vectors[i].iov_len = datagramSize;
+			memset(&messages[i], 0, sizeof(messages[i]));
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+		int received = recvmmsg(mSocket, messages, batch, MSG_DONTWAIT, nullptr);
+		if (received <= 0){
+			continue;
+		}
+		int64_t now = monotonicNs();
+		for (int i = 0; i < received; i++){
+			if (messages[i].msg_hdr.msg_flags & MSG_TRUNC){
+				mMalformed.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			size_t numCommands = 0;
+			int errors = parseOscPacket(buffers.data() + i * datagramSize, messages[i].msg_len, now,
+				commands.data(), maxCommands, numCommands);
+			mMalformed.fetch_add(errors, std::memory_order_relaxed);
+			for (size_t c = 0; c < numCommands; c++){
+				if (!mQueue.push(commands[c])){
+					mDropped.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			mReceived.fetch_add(numCommands, std::memory_order_relaxed);
+		}
+	}
+}
+
+#else
+
+//--------------------------------------------------------------
+bool OscServer::start(int port, std::string& report){
+	report += "osc: only supported on Linux. ";
+	return false;
+}
+
+void OscServer::stop(){}
+void OscServer::run(){}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#include "realtime.h"
+#include "spsc_queue.h"
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class SynthCommandType
+{
+	NoteOn,			// /note/on i:pitch [f:volume], pitch 0-maxPitch as in pitchToFrequency (A4 = 57)
+	NoteOff,		// /note/off i:pitch
+	Brillance,		// /brillance i
+	Octave,			// /octave i, minOctave-maxOctave
+	Volume,			// /volume f, 0-1
+	FilterCutoff,	// /filter/cutoff f, Hz
+	FilterQ,		// /filter/q f
+	WaveShape,		// /waveshape i (0 sin, 1 square, 2 saw) or s ("sin", "square", "saw")
+	Patch,			// /patch i, index in the bank
+	ModLfo,			// /mod/lfo i:slot i|s:shape f:rate, see modulation.h
+	ModEnvelope,	// /mod/env i:slot f:attack f:decay f:sustain f:release, seconds
+	ModRoute,		// /mod/route i:route i:slot i|s:target f:depth, depth 0 removes it
+};
+
+typedef struct{
+	SynthCommandType type;
+	int intValue;
+	float value;			// negative volume for /note/on: the current volume
+	float arguments[4];		// /mod/*: the arguments after the first, names as their index
+	int64_t receivedNs;		// monotonicNs() when the datagram was read
+} s_synth_command;
+
+typedef struct{
+	bool headless = false;	// --headless, no window, implies --osc
+	bool enabled = false;	// --osc
+	int port = 9000;		// --osc-port=, bound on 127.0.0.1 only
+} s_server_settings;
+
+s_server_settings parseServerArguments(int argc, char* argv[]);
+
+// Parses one OSC packet, message or bundle, into at most maxCommands
+// commands. Returns the number of malformed or unknown messages. Bundles
+// are flattened and their time tags ignored: commands take effect at the
+// first block that follows their arrival.
+int parseOscPacket(const char* data, size_t size, int64_t receivedNs,
+	s_synth_command* commands, size_t maxCommands, size_t& numCommands);
+
+// UDP listener on a thread of its own. Commands go to the audio thread
+// through a wait free queue: when it is full they are dropped and counted,
+// the network never blocks the audio.
+class OscServer{
+
+	public:
+
+		static constexpr size_t queueSize = 1 << 16;
+		typedef SpscQueue<s_synth_command, queueSize> CommandQueue;
+
+		~OscServer();
+
+		bool start(int port, std::string& report);
+		void stop();
+		bool isRunning() const { return mThread.joinable(); }
+		s_thread_handle thread() { return threadHandle(mThread); }	// for pinThread, while running
+
+		CommandQueue& commands() { return mQueue; }	// popped by the audio thread only
+
+		uint64_t received() const { return mReceived.load(std::memory_order_relaxed); }
+		uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+		uint64_t malformed() const { return mMalformed.load(std::memory_order_relaxed); }
+
+	private:
+
+		void run();
+
+		int mSocket = -1;
+		std::thread mThread;
+		std::atomic<bool> mStop{false};
+		CommandQueue mQueue;
+		std::atomic<uint64_t> mReceived{0};
+		std::atomic<uint64_t> mDropped{0};
+		std::atomic<uint64_t> mMalformed{0};
+};
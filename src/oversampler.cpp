@@ -0,0 +1,110 @@
+#include "oversampler.h"
+#include "dsp_kernels.h"
+#include <cmath>
+#include <algorithm>
+
+//--------------------------------------------------------------
+static double besselI0(double x){
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; k++){
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+//--------------------------------------------------------------
+void HalfBandDecimator::setup(int numTaps, size_t maxOutputFrames){
+	// Kaiser windowed sinc cut at a quarter of the input rate. Only the odd
+	// distances from the centre are kept, the even ones are exactly zero.
+	const double beta = 8.0;
+	const double halfLength = 2.0 * numTaps;
+	mCoefficients.assign(numTaps, 0.f);
+	double sum = 0.0;
+	for (int j = 0; j < numTaps; j++){
+		int d = (2 * numTaps - 1) - 2 * j;
+		double x = d / halfLength;
+		double window = besselI0(beta * sqrt(1.0 - x * x)) / besselI0(beta);
+		double h = sin(M_PI * d / 2.0) / (M_PI * d) * window;
+		mCoefficients[j] = h;
+		sum += h;
+	}
+	// unity gain at DC: both sides of the taps must add up to the other half
+	for (auto& c : mCoefficients){
+		c *= 0.25 / sum;
+	}
+
+	size_t history = 4 * numTaps - 2;
+	mSignal.assign(history + 2 * maxOutputFrames, 0.f);
+	mEven.assign(mSignal.size() / 2, 0.f);
+	mOdd.assign(mSignal.size() / 2, 0.f);
+}
+
+//--------------------------------------------------------------
+void HalfBandDecimator::reset(){
+	std::fill(mSignal.begin(), mSignal.end(), 0.f);
+}
+
+//--------------------------------------------------------------
+void HalfBandDecimator::process(const float* input, float* output, size_t outputFrames){
+	const int numTaps = mCoefficients.size();
+	const size_t history = 4 * numTaps - 2;
+	const size_t length = history + 2 * outputFrames;
+
+	std::copy(input, input + 2 * outputFrames, mSignal.begin() + history);
+	for (size_t m = 0; m < length / 2; m++){
+		mEven[m] = mSignal[2 * m];
+		mOdd[m] = mSignal[2 * m + 1];
+	}
+
+	dspKernels().halfBand(mEven.data(), mOdd.data(), mCoefficients.data(), numTaps, output, outputFrames);
+
+	std::copy(mSignal.begin() + 2 * outputFrames, mSignal.begin() + length, mSignal.begin());
+}
+
+//--------------------------------------------------------------
+void Oversampler::setup(size_t maxOutputFrames){
+	mStages[0].setup(12, maxOutputFrames);
+	mStages[1].setup(5, 2 * maxOutputFrames);
+	mStages[2].setup(3, 4 * maxOutputFrames);
+	mScratch[0].assign(2 * maxOutputFrames, 0.f);
+	mScratch[1].assign(4 * maxOutputFrames, 0.f);
+	mFactor = 1;
+}
+
+//--------------------------------------------------------------
+void Oversampler::process(const float* input, float* output, size_t outputFrames, int factor){
+	if (factor != mFactor){
+		// the histories belong to another rate, start over from silence
+		for (auto& stage : mStages){
+			stage.reset();
+		}
+		mFactor = factor;
+	}
+	if (factor <= 1){
+		if (input != output){
+			std::copy(input, input + outputFrames, output);
+		}
+		return;
+	}
+
+	int numStages = factor >= 8 ? 3 : (factor >= 4 ? 2 : 1);
+	const float* current = input;
+	for (int s = numStages - 1; s >= 0; s--){
+		float* destination = (s == 0) ? output : mScratch[s - 1].data();
+		mStages[s].process(current, destination, outputFrames << s);
+		current = destination;
+	}
+}
+
+//--------------------------------------------------------------
+int Oversampler::latency(int factor) const {
+	int numStages = factor >= 8 ? 3 : (factor >= 4 ? 2 : (factor >= 2 ? 1 : 0));
+	// each stage delays by latency() samples of its own input rate
+	float samples = 0.f;
+	for (int s = 0; s < numStages; s++){
+		samples += mStages[s].latency() / float(2 << s);
+	}
+	return (int) ceil(samples);
+}
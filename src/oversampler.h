@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// One decimate-by-two stage: symmetric half-band FIR in polyphase form.
+// Every other coefficient of a half-band filter is zero except the centre
+// one (0.5), so the odd phase reduces to a single delayed sample and only
+// the even phase is convolved, folding the symmetric taps two by two.
+class HalfBandDecimator{
+
+	public:
+
+		void setup(int numTaps, size_t maxOutputFrames);	// numTaps non zero taps on each side
+		void reset();
+		void process(const float* input, float* output, size_t outputFrames);
+		int latency() const { return 2 * (int) mCoefficients.size() - 1; }	// in input samples
+
+	private:
+
+		std::vector<float> mCoefficients;	// non zero taps of one side, outermost first
+		std::vector<float> mSignal;			// history followed by the current input
+		std::vector<float> mEven;
+		std::vector<float> mOdd;
+};
+
+// Cascade of half-band decimators bringing a 2x, 4x or 8x oversampled
+// signal back to the base sample rate.
+class Oversampler{
+
+	public:
+
+		static constexpr int maxFactor = 8;
+
+		void setup(size_t maxOutputFrames);
+		void process(const float* input, float* output, size_t outputFrames, int factor);
+		int latency(int factor) const;	// in output samples
+
+	private:
+
+		// stage 0 is the last one (2x -> 1x) and the steepest, earlier
+		// stages only have to protect the band of the following ones
+		HalfBandDecimator mStages[3];
+		std::vector<float> mScratch[2];
+		int mFactor = 1;
+};
@@ -0,0 +1,464 @@
+#include "patch.h"
+#include "engine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char bankMagic[8] = {'S', 'Y', 'N', 'B', 'A', 'N', 'K', 0};
+static constexpr size_t bankHeaderSize = 16;
+static constexpr size_t nameSize = sizeof(((s_patch*) nullptr)->name);
+
+//--------------------------------------------------------------
+s_patch defaultPatch(){
+	s_patch patch;
+	memset(&patch, 0, sizeof(patch));
+	strncpy(patch.name, "init", nameSize - 1);
+	patch.waveShape = 0;
+	patch.brillance = 1;
+	patch.octaveIndex = 4;
+	patch.volume = 0.1f;
+	patch.lowFrequency = 500.f;
+	patch.lowQ = 0.1f;
+	patch.highFrequency = 10000.f;
+	patch.highQ = 0.1f;
+	patch.oversamplingFactor = 1;
+	patch.granularEnabled = false;
+	patch.grainDensity = 200.f;
+	patch.grainSize = 0.05f;
+	patch.grainPitchJitter = 0.f;
+	patch.limiterTruePeak = false;
+	patch.modulation = defaultModulation();
+	return patch;
+}
+
+//--------------------------------------------------------------
+// The ranges of SynthEngine::applyCommand and of the keyboard; values that
+// are not even numbers take the default ones.
+void clampPatch(s_patch& patch, size_t sampleRate){
+	const s_patch defaults = defaultPatch();
+	auto bound = [](float value, float fallback, float low, float high){
+		return std::clamp(std::isfinite(value) ? value : fallback, low, high);
+	};
+	patch.name[nameSize - 1] = 0;
+	patch.waveShape = std::clamp(patch.waveShape, 0, 2);
+	patch.brillance = std::clamp(patch.brillance, 1, SynthEngine::maxHarmonics);
+	patch.octaveIndex = std::clamp(patch.octaveIndex, minOctave, maxOctave);
+	patch.volume = bound(patch.volume, defaults.volume, 0.f, 1.f);
+	patch.lowFrequency = bound(patch.lowFrequency, defaults.lowFrequency, 10.f, 0.49f * sampleRate);
+	patch.highFrequency = bound(patch.highFrequency, defaults.highFrequency, 10.f, 0.49f * sampleRate);
+	patch.lowQ = bound(patch.lowQ, defaults.lowQ, 0.01f, 100.f);
+	patch.highQ = bound(patch.highQ, defaults.highQ, 0.01f, 100.f);
+	patch.oversamplingFactor = std::clamp(patch.oversamplingFactor, 1, Oversampler::maxFactor);
+	patch.grainDensity = bound(patch.grainDensity, defaults.grainDensity, 1.f, 20000.f);
+	patch.grainSize = bound(patch.grainSize, defaults.grainSize, 0.002f, 0.5f);
+	patch.grainPitchJitter = bound(patch.grainPitchJitter, defaults.grainPitchJitter, 0.f, 12.f);
+	s_modulation_settings& modulation = patch.modulation;
+	const s_modulator_settings& modulatorDefaults = defaults.modulation.modulators[0];
+	for (auto& modulator : modulation.modulators){
+		modulator.rate = bound(modulator.rate, modulatorDefaults.rate, 0.f, 1000.f);
+		modulator.attack = bound(modulator.attack, modulatorDefaults.attack, 0.f, 60.f);
+		modulator.decay = bound(modulator.decay, modulatorDefaults.decay, 0.f, 60.f);
+		modulator.sustain = bound(modulator.sustain, modulatorDefaults.sustain, 0.f, 1.f);
+		modulator.release = bound(modulator.release, modulatorDefaults.release, 0.f, 60.f);
+	}
+	for (auto& route : modulation.routes){
+		route.source = std::clamp(route.source, 0, maxModulators - 1);
+		route.depth = bound(route.depth, 0.f, -maxModDepth, maxModDepth);
+	}
+}
+
+//--------------------------------------------------------------
+std::vector<s_patch> factoryPatches(){
+	std::vector<s_patch> patches;
+	patches.reserve(9);
+	auto add = [&](const char* name, int waveShape, int brillance, float lowFrequency, float lowQ, int oversamplingFactor){
+		s_patch patch = defaultPatch();
+		strncpy(patch.name, name, nameSize - 1);
+		patch.waveShape = waveShape;
+		patch.brillance = brillance;
+		patch.lowFrequency = lowFrequency;
+		patch.lowQ = lowQ;
+		patch.oversamplingFactor = oversamplingFactor;
+		patches.push_back(patch);
+		return &patches.back();
+	};
+	add("init", 0, 1, 500.f, 0.1f, 1);
+	add("soft sine", 0, 1, 2000.f, 0.7f, 1);
+	add("hollow square", 1, 12, 3000.f, 0.7f, 2);
+	add("bright saw", 2, 40, 12000.f, 0.7f, 4);
+	add("dark saw", 2, 20, 600.f, 2.f, 2);
+	add("resonant square", 1, 30, 1200.f, 8.f, 4);
+	s_patch* cloud = add("grain cloud", 2, 16, 5000.f, 0.7f, 1);
+	cloud->granularEnabled = true;
+	cloud->grainDensity = 400.f;
+	cloud->grainSize = 0.08f;
+	cloud->grainPitchJitter = 0.3f;
+	s_patch* loud = add("loud saw, true peak", 2, 60, 16000.f, 0.7f, 8);
+	loud->volume = 0.3f;
+	loud->limiterTruePeak = true;
+	s_patch* wobble = add("wobble saw", 2, 24, 800.f, 4.f, 2);
+	wobble->modulation.modulators[0] = {ModShape::Sine, 3.f, 0.01f, 0.2f, 0.7f, 0.3f};
+	wobble->modulation.modulators[1] = {ModShape::Envelope, 1.f, 0.005f, 0.4f, 0.2f, 0.3f};
+	wobble->modulation.routes[0] = {0, ModTarget::FilterCutoff, 1.5f};
+	wobble->modulation.routes[1] = {1, ModTarget::FilterCutoff, 2.f};
+	wobble->modulation.routes[2] = {0, ModTarget::Pan, 0.3f};
+	return patches;
+}
+
+//--------------------------------------------------------------
+// Fields of the record, in file order. Every field takes 4 bytes, except
+// the name.
+typedef struct{
+	unsigned char* data;
+	size_t size;
+	size_t offset;
+} s_record;
+
+static void putWord(s_record& record, uint32_t value){
+	for (int i = 0; i < 4; i++){
+		record.data[record.offset + i] = (value >> (8 * i)) & 0xFF;
+	}
+	record.offset += 4;
+}
+
+static bool getWord(s_record& record, uint32_t& value){
+	if (record.offset + 4 > record.size){
+		return false;
+	}
+	value = 0;
+	for (int i = 0; i < 4; i++){
+		value |= uint32_t(record.data[record.offset + i]) << (8 * i);
+	}
+	record.offset += 4;
+	return true;
+}
+
+static void putInt(s_record& record, int value){ putWord(record, uint32_t(int32_t(value))); }
+static void putFloat(s_record& record, float value){ uint32_t bits; memcpy(&bits, &value, 4); putWord(record, bits); }
+static void getInt(s_record& record, int& value){ uint32_t bits; if (getWord(record, bits)) value = int32_t(bits); }
+// a NaN or infinite field keeps its default, as a missing one
+static void getFloat(s_record& record, float& value){
+	uint32_t bits;
+	float read;
+	if (getWord(record, bits)){
+		memcpy(&read, &bits, 4);
+		if (std::isfinite(read)){
+			value = read;
+		}
+	}
+}
+static void getBool(s_record& record, bool& value){ uint32_t bits; if (getWord(record, bits)) value = (bits != 0); }
+
+static void encodePatch(const s_patch& patch, s_record& record){
+	memcpy(record.data + record.offset, patch.name, nameSize);
+	record.offset += nameSize;
+	putInt(record, patch.waveShape);
+	putInt(record, patch.brillance);
+	putInt(record, patch.octaveIndex);
+	putFloat(record, patch.volume);
+	putFloat(record, patch.lowFrequency);
+	putFloat(record, patch.lowQ);
+	putFloat(record, patch.highFrequency);
+	putFloat(record, patch.highQ);
+	putInt(record, patch.oversamplingFactor);
+	putInt(record, patch.granularEnabled ? 1 : 0);
+	putFloat(record, patch.grainDensity);
+	putFloat(record, patch.grainSize);
+	putFloat(record, patch.grainPitchJitter);
+	putInt(record, patch.limiterTruePeak ? 1 : 0);
+	for (const auto& modulator : patch.modulation.modulators){
+		putInt(record, static_cast<int>(modulator.shape));
+		putFloat(record, modulator.rate);
+		putFloat(record, modulator.attack);
+		putFloat(record, modulator.decay);
+		putFloat(record, modulator.sustain);
+		putFloat(record, modulator.release);
+	}
+	for (const auto& route : patch.modulation.routes){
+		putInt(record, route.source);
+		putInt(record, static_cast<int>(route.target));
+		putFloat(record, route.depth);
+	}
+}
+
+static void decodePatch(s_record& record, s_patch& patch){
+	patch = defaultPatch();
+	if (record.size >= nameSize){
+		memcpy(patch.name, record.data, nameSize);
+		patch.name[nameSize - 1] = 0;
+		record.offset = nameSize;
+	} else {
+		return;
+	}
+	getInt(record, patch.waveShape);
+	getInt(record, patch.brillance);
+	getInt(record, patch.octaveIndex);
+	getFloat(record, patch.volume);
+	getFloat(record, patch.lowFrequency);
+	getFloat(record, patch.lowQ);
+	getFloat(record, patch.highFrequency);
+	getFloat(record, patch.highQ);
+	getInt(record, patch.oversamplingFactor);
+	getBool(record, patch.granularEnabled);
+	getFloat(record, patch.grainDensity);
+	getFloat(record, patch.grainSize);
+	getFloat(record, patch.grainPitchJitter);
+	getBool(record, patch.limiterTruePeak);
+	for (auto& modulator : patch.modulation.modulators){
+		int shape = static_cast<int>(modulator.shape);
+		getInt(record, shape);
+		modulator.shape = static_cast<ModShape>(std::min(std::max(shape, 0), static_cast<int>(ModShape::sizeShapes) - 1));
+		getFloat(record, modulator.rate);
+		getFloat(record, modulator.attack);
+		getFloat(record, modulator.decay);
+		getFloat(record, modulator.sustain);
+		getFloat(record, modulator.release);
+	}
+	for (auto& route : patch.modulation.routes){
+		int target = static_cast<int>(route.target);
+		getInt(record, route.source);
+		getInt(record, target);
+		route.target = static_cast<ModTarget>(std::min(std::max(target, 0), static_cast<int>(ModTarget::sizeTargets) - 1));
+		getFloat(record, route.depth);
+	}
+}
+
+static size_t recordSize(){
+	static size_t size = 0;
+	if (size == 0){
+		// measured by encoding into a scratch record larger than any version
+		unsigned char scratch[512];
+		s_record record = {scratch, sizeof(scratch), 0};
+		encodePatch(defaultPatch(), record);
+		size = record.offset;
+	}
+	return size;
+}
+
+//--------------------------------------------------------------
+PatchBank::~PatchBank(){
+	close();
+}
+
+//--------------------------------------------------------------
+bool PatchBank::open(const std::string& path, std::string& report){
+#ifdef __linux__
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0){
+		report += "no bank " + path + " (" + std::string(strerror(errno)) + "). ";
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < bankHeaderSize){
+		report += path + " is not a bank. ";
+		::close(fd);
+		return false;
+	}
+	void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED){
+		report += "could not map " + path + ". ";
+		return false;
+	}
+	mData = static_cast<const unsigned char*>(memory);
+	mSize = info.st_size;
+
+	uint16_t version = mData[8] | (mData[9] << 8);
+	mRecordSize = mData[10] | (mData[11] << 8);
+	mNumPatches = mData[12] | (mData[13] << 8) | (mData[14] << 16) | (size_t(mData[15]) << 24);
+	if (memcmp(mData, bankMagic, 8) != 0 || version == 0 || version > patchBankVersion || mRecordSize == 0
+		|| bankHeaderSize + mRecordSize * mNumPatches > mSize){
+		report += path + " is not a bank this version can read. ";
+		close();
+		return false;
+	}
+	return true;
+#else
+	report += "banks are only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+void PatchBank::close(){
+#ifdef __linux__
+	if (mData != nullptr){
+		munmap(const_cast<unsigned char*>(mData), mSize);
+	}
+#endif
+	mData = nullptr;
+	mSize = 0;
+	mNumPatches = 0;
+}
+
+//--------------------------------------------------------------
+bool PatchBank::read(size_t index, s_patch& patch) const {
+	if (index >= mNumPatches){
+		return false;
+	}
+	s_record record = {const_cast<unsigned char*>(mData) + bankHeaderSize + index * mRecordSize, mRecordSize, 0};
+	decodePatch(record, patch);
+	return true;
+}
+
+//--------------------------------------------------------------
+bool PatchBank::save(const std::string& path, const std::vector<s_patch>& patches, std::string& report){
+	const size_t size = recordSize();
+	std::vector<unsigned char> data(bankHeaderSize + size * patches.size(), 0);
+	memcpy(data.data(), bankMagic, 8);
+	data[8] = patchBankVersion & 0xFF;
+	data[9] = patchBankVersion >> 8;
+	data[10] = size & 0xFF;
+	data[11] = size >> 8;
+	for (int i = 0; i < 4; i++){
+		data[12 + i] = (patches.size() >> (8 * i)) & 0xFF;
+	}
+	for (size_t i = 0; i < patches.size(); i++){
+		s_record record = {data.data() + bankHeaderSize + i * size, size, 0};
+		encodePatch(patches[i], record);
+	}
+
+	// written aside then renamed, so that a mapped bank is never changed
+	// under its readers and a crash never leaves half a bank
+	std::string temporary = path + ".tmp";
+	std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.close();
+	if (!file || std::rename(temporary.c_str(), path.c_str()) != 0){
+		report += "could not write " + path + ". ";
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+PatchLoader::~PatchLoader(){
+	stop();
+	collectGarbage();
+	delete mPending.exchange(nullptr);
+}
+
+//--------------------------------------------------------------
+void PatchLoader::start(size_t rate){
+	stop();
+	sampleRate = rate;
+	mStop.store(false);
+	mThread = std::thread(&PatchLoader::run, this);
+}
+
+//--------------------------------------------------------------
+void PatchLoader::stop(){
+	if (mThread.joinable()){
+		mStop.store(true);
+		mWake.notify_one();
+		mThread.join();
+	}
+}
+
+//--------------------------------------------------------------
+bool PatchLoader::openBank(const std::string& path, std::string& report){
+	std::lock_guard<std::mutex> lock(mBankMutex);
+	mPath = path;
+	return mBank.open(path, report);
+}
+
+//--------------------------------------------------------------
+bool PatchLoader::store(size_t index, const s_patch& patch, std::string& report){
+	std::lock_guard<std::mutex> lock(mBankMutex);
+	std::vector<s_patch> patches(std::max(mBank.size(), index + 1), defaultPatch());
+	for (size_t i = 0; i < mBank.size(); i++){
+		mBank.read(i, patches[i]);
+	}
+	patches[index] = patch;
+	if (!PatchBank::save(mPath, patches, report)){
+		return false;
+	}
+	return mBank.open(mPath, report);
+}
+
+//--------------------------------------------------------------
+size_t PatchLoader::bankSize(){
+	std::lock_guard<std::mutex> lock(mBankMutex);
+	return mBank.size();
+}
+
+//--------------------------------------------------------------
+std::string PatchLoader::bankPath(){
+	std::lock_guard<std::mutex> lock(mBankMutex);
+	return mPath;
+}
+
+//--------------------------------------------------------------
+void PatchLoader::request(int index){
+	// no lock: a missed wake up only costs the timeout of the loader
+	mRequested.store(index, std::memory_order_release);
+	mWake.notify_one();
+}
+
+//--------------------------------------------------------------
+void PatchLoader::run(){
+	while (!mStop.load()){
+		{
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			mWake.wait_for(lock, std::chrono::milliseconds(20), [this]{
+				return mStop.load() || mRequested.load(std::memory_order_acquire) >= 0;
+			});
+		}
+		int index = mRequested.exchange(-1, std::memory_order_acq_rel);
+		if (index < 0){
+			continue;
+		}
+
+		s_prepared_patch* prepared = new s_prepared_patch;
+		prepared->index = index;
+		{
+			std::lock_guard<std::mutex> lock(mBankMutex);
+			if (!mBank.read(index, prepared->patch)){
+				delete prepared;
+				continue;
+			}
+		}
+		// a bank saved at a higher rate, or edited by hand, must not make
+		// the filters unstable
+		clampPatch(prepared->patch, sampleRate);
+		const s_patch& patch = prepared->patch;
+		prepared->lowFilter = designLowPass(patch.lowFrequency, patch.lowQ, sampleRate);
+		prepared->highFilter = designHighPass(patch.highFrequency, patch.highQ, sampleRate);
+
+		// a patch the audio thread has not taken yet is simply replaced
+		delete mPending.exchange(prepared, std::memory_order_acq_rel);
+	}
+}
+
+//--------------------------------------------------------------
+const s_prepared_patch* PatchLoader::take(){
+	// one patch in flight at a time, until the GUI thread has freed the last one
+	if (mRetired.load(std::memory_order_acquire) != nullptr){
+		return nullptr;
+	}
+	return mPending.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+//--------------------------------------------------------------
+void PatchLoader::retire(const s_prepared_patch* prepared){
+	mCurrent.store(prepared->index, std::memory_order_relaxed);
+	mRetired.store(prepared, std::memory_order_release);
+}
+
+//--------------------------------------------------------------
+void PatchLoader::collectGarbage(){
+	delete mRetired.exchange(nullptr, std::memory_order_acq_rel);
+}
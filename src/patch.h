@@ -0,0 +1,130 @@
+#pragma once
+#include "filter_design.h"
+#include "modulation.h"
+#include "realtime.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Every setting of a sound. Kept apart from the engine so that banks can be
+// read, written and prepared without it.
+typedef struct{
+	char name[24];
+	int waveShape;				// WaveShape order: sin, square, saw
+	int brillance;
+	int octaveIndex;
+	float volume;
+	float lowFrequency;
+	float lowQ;
+	float highFrequency;
+	float highQ;
+	int oversamplingFactor;
+	bool granularEnabled;
+	float grainDensity;
+	float grainSize;
+	float grainPitchJitter;
+	bool limiterTruePeak;
+	s_modulation_settings modulation;	// since version 2
+} s_patch;
+
+s_patch defaultPatch();
+// Brings every setting of a patch read from a file into the ranges the
+// commands and the keyboard accept at this sample rate, before anything is
+// derived from it: a bank is untrusted input, a Q of 0 makes the filters
+// unstable and a huge octave or grain density stalls the audio thread.
+void clampPatch(s_patch& patch, size_t sampleRate);
+std::vector<s_patch> factoryPatches();	// written when there is no bank yet
+
+// Bank file, all little endian:
+//   header  "SYNBANK" + '\0', uint16 version, uint16 record size,
+//           uint32 number of patches
+//   records one per patch, fixed size, fields in the order of s_patch
+// A reader takes the fields it knows from the start of each record and
+// keeps the defaults for the others, so records can grow in later versions
+// without breaking older banks. A single patch is a bank of one.
+// Version 2 appends the modulators (shape, rate, attack, decay, sustain,
+// release) then the routes (slot, target, depth).
+static constexpr uint16_t patchBankVersion = 2;
+
+// Read only view of a bank file, mapped in memory: opening a bank of
+// thousands of patches costs nothing until a patch is decoded.
+class PatchBank{
+
+	public:
+
+		~PatchBank();
+
+		bool open(const std::string& path, std::string& report);
+		void close();
+		size_t size() const { return mNumPatches; }
+		bool read(size_t index, s_patch& patch) const;
+
+		static bool save(const std::string& path, const std::vector<s_patch>& patches, std::string& report);
+
+	private:
+
+		const unsigned char* mData = nullptr;
+		size_t mSize = 0;
+		size_t mNumPatches = 0;
+		size_t mRecordSize = 0;
+};
+
+// A patch with everything the audio thread derives from it, computed ahead.
+typedef struct{
+	int index;
+	s_patch patch;
+	s_filter lowFilter;
+	s_filter highFilter;
+} s_prepared_patch;
+
+// Prepares the requested patches on a thread of its own. The audio thread
+// picks a prepared patch up at a block boundary with take(), applies it and
+// hands it back with retire(); the GUI thread frees it in collectGarbage().
+// Only the latest request counts when several arrive in a row.
+class PatchLoader{
+
+	public:
+
+		~PatchLoader();
+
+		void start(size_t sampleRate);
+		void stop();
+		s_thread_handle thread() { return threadHandle(mThread); }	// for pinThread, while started
+
+		// GUI thread
+		bool openBank(const std::string& path, std::string& report);
+		bool store(size_t index, const s_patch& patch, std::string& report);	// rewrites the bank file
+		size_t bankSize();
+		std::string bankPath();
+		void collectGarbage();
+
+		// any thread, wait free
+		void request(int index);
+		int current() const { return mCurrent.load(std::memory_order_relaxed); }
+
+		// audio thread
+		const s_prepared_patch* take();
+		void retire(const s_prepared_patch* prepared);
+
+	private:
+
+		void run();
+
+		PatchBank mBank;
+		std::string mPath;
+		std::mutex mBankMutex;		// between the GUI and the loader thread only
+		std::thread mThread;
+		std::mutex mWakeMutex;
+		std::condition_variable mWake;
+		std::atomic<bool> mStop{false};
+		std::atomic<int> mRequested{-1};
+		std::atomic<int> mCurrent{-1};
+		std::atomic<s_prepared_patch*> mPending{nullptr};
+		std::atomic<const s_prepared_patch*> mRetired{nullptr};
+		size_t sampleRate = 44100;
+};
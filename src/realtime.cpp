@@ -0,0 +1,272 @@
+#include "realtime.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sstream>
+
+#ifdef __linux__
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#if __has_include(<gio/gio.h>)
+#include <gio/gio.h>
+#define SYNTH_HAVE_RTKIT 1
+#endif
+#endif
+
+//--------------------------------------------------------------
+static std::vector<int> parseCpuList(const std::string& list){
+	// far above any machine, only bounds the ranges expanded here
+	static constexpr long maxCpuNumber = 1 << 16;
+	std::vector<int> cpus;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')){
+		if (item.empty()){
+			continue;
+		}
+		const char* text = item.c_str();
+		char* end = nullptr;
+		long first = strtol(text, &end, 10);
+		long last = first;
+		bool valid = (end != text);
+		if (valid && *end == '-'){
+			const char* second = end + 1;
+			last = strtol(second, &end, 10);
+			valid = (end != second);
+		}
+		if (!valid || *end != 0 || first < 0 || last < first || last >= maxCpuNumber){
+			cpus.push_back(-1);
+			continue;
+		}
+		for (long cpu = first; cpu <= last; cpu++){
+			cpus.push_back(int(cpu));
+		}
+	}
+	return cpus;
+}
+
+//--------------------------------------------------------------
+s_realtime_settings parseRealtimeArguments(int argc, char* argv[]){
+	s_realtime_settings settings;
+	for (int i = 1; i < argc; i++){
+		std::string argument = argv[i];
+		if (argument == "--realtime"){
+			settings.enabled = true;
+		} else if (argument == "--no-mlock"){
+			settings.lockMemory = false;
+		} else if (argument.rfind("--rt-priority=", 0) == 0){
+			settings.priority = atoi(argument.c_str() + strlen("--rt-priority="));
+		} else if (argument.rfind("--audio-cpus=", 0) == 0){
+			settings.audioCpus = parseCpuList(argument.substr(strlen("--audio-cpus=")));
+		} else if (argument.rfind("--worker-cpus=", 0) == 0){
+			settings.workerCpus = parseCpuList(argument.substr(strlen("--worker-cpus=")));
+		}
+	}
+	return settings;
+}
+
+//--------------------------------------------------------------
+s_thread_handle currentThread(){
+	s_thread_handle handle;
+#ifdef __linux__
+	handle.thread = (uint64_t) pthread_self();
+	handle.tid = syscall(SYS_gettid);
+#else
+	handle.thread = 0;
+	handle.tid = 0;
+#endif
+	return handle;
+}
+
+//--------------------------------------------------------------
+s_thread_handle threadHandle(std::thread& thread){
+	s_thread_handle handle;
+#ifdef __linux__
+	handle.thread = (uint64_t) thread.native_handle();
+#else
+	handle.thread = 0;
+#endif
+	handle.tid = 0;
+	return handle;
+}
+
+#ifdef SYNTH_HAVE_RTKIT
+//--------------------------------------------------------------
+// RealtimeKit grants SCHED_FIFO to unprivileged desktop users, provided
+// RLIMIT_RTTIME is bounded so that a runaway thread cannot lock the machine.
+static bool promoteWithRtkit(long tid, int priority, std::string& report){
+	GError* error = nullptr;
+	GDBusConnection* bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+	if (bus == nullptr){
+		report += "rtkit: no system bus (" + std::string(error->message) + "). ";
+		g_error_free(error);
+		return false;
+	}
+
+	GVariant* maxPriority = g_dbus_connection_call_sync(bus, "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+		"org.freedesktop.DBus.Properties", "Get", g_variant_new("(ss)", "org.freedesktop.RealtimeKit1", "MaxRealtimePriority"),
+		G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, 1000, nullptr, nullptr);
+	if (maxPriority != nullptr){
+		GVariant* value = nullptr;
+		g_variant_get(maxPriority, "(v)", &value);
+		int limit = g_variant_get_int32(value);
+		if (priority > limit){
+			report += "rtkit: priority lowered to " + std::to_string(limit) + ". ";
+			priority = limit;
+		}
+		g_variant_unref(value);
+		g_variant_unref(maxPriority);
+	}
+
+	struct rlimit rttime;
+	rttime.rlim_cur = rttime.rlim_max = 200000;	// microseconds of CPU without blocking
+	setrlimit(RLIMIT_RTTIME, &rttime);
+
+	GVariant* result = g_dbus_connection_call_sync(bus, "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+		"org.freedesktop.RealtimeKit1", "MakeThreadRealtime", g_variant_new("(tu)", (guint64) tid, (guint32) priority),
+		nullptr, G_DBUS_CALL_FLAGS_NONE, 1000, nullptr, &error);
+	g_object_unref(bus);
+	if (result == nullptr){
+		report += "rtkit: " + std::string(error->message) + ". ";
+		g_error_free(error);
+		return false;
+	}
+	g_variant_unref(result);
+	report += "SCHED_FIFO " + std::to_string(priority) + " through rtkit. ";
+	return true;
+}
+#endif
+
+//--------------------------------------------------------------
+bool promoteToRealtime(const s_thread_handle& thread, int priority, std::string& report){
+#ifdef __linux__
+	priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(priority, sched_get_priority_max(SCHED_FIFO)));
+	struct sched_param param;
+	param.sched_priority = priority;
+	int result = pthread_setschedparam((pthread_t) thread.thread, SCHED_FIFO, &param);
+	if (result == 0){
+		report += "SCHED_FIFO " + std::to_string(priority) + ". ";
+		return true;
+	}
+	report += "SCHED_FIFO refused (" + std::string(strerror(result)) + ", needs CAP_SYS_NICE or an rtprio limit in /etc/security/limits.conf). ";
+#ifdef SYNTH_HAVE_RTKIT
+	return promoteWithRtkit(thread.tid, priority, report);
+#else
+	return false;
+#endif
+#else
+	report += "realtime scheduling is only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+bool lockMemory(std::string& report){
+#ifdef __linux__
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0){
+		report += "memory locked. ";
+		return true;
+	}
+	int error = errno;
+	report += "mlockall failed (" + std::string(strerror(error)) + ", needs CAP_IPC_LOCK or a larger memlock limit). ";
+	return false;
+#else
+	report += "memory locking is only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+bool pinThread(const s_thread_handle& thread, const std::vector<int>& cpus, std::string& report){
+	if (cpus.empty()){
+		return true;
+	}
+#ifdef __linux__
+	// CPU_SET ignores what does not fit in the set, the thread would end up
+	// on fewer cpus than reported
+	long configured = sysconf(_SC_NPROCESSORS_CONF);
+	int numCpus = (configured > 0) ? int(std::min<long>(configured, CPU_SETSIZE)) : CPU_SETSIZE;
+	for (int cpu : cpus){
+		if (cpu < 0){
+			report += "not a cpu list, give numbers and ranges such as 0,2-3. ";
+			return false;
+		} else if (cpu >= numCpus){
+			report += "no cpu " + std::to_string(cpu) + " on this machine (0-" + std::to_string(numCpus - 1) + "). ";
+			return false;
+		}
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	std::string list;
+	for (int cpu : cpus){
+		CPU_SET(cpu, &set);
+		list += (list.empty() ? "" : ",") + std::to_string(cpu);
+	}
+	int result = pthread_setaffinity_np((pthread_t) thread.thread, sizeof(set), &set);
+	if (result != 0){
+		report += "pinning to cpus " + list + " failed (" + std::string(strerror(result)) + "). ";
+		return false;
+	}
+	report += "cpus " + list + ". ";
+	return true;
+#else
+	report += "thread pinning is only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+void prefaultStack(size_t bytes){
+#ifdef __linux__
+	volatile unsigned char* stack = static_cast<volatile unsigned char*>(alloca(bytes));
+	for (size_t i = 0; i < bytes; i += 4096){
+		stack[i] = 0;
+	}
+#endif
+}
+
+//--------------------------------------------------------------
+int64_t monotonicNs(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//--------------------------------------------------------------
+void DropoutCounter::setup(size_t bufferSize, size_t sampleRate){
+	mPeriodNs = int64_t(1e9 * bufferSize / sampleRate);
+	mSampleRate = sampleRate;
+	mPreviousStartNs = 0;
+}
+
+//--------------------------------------------------------------
+void DropoutCounter::restart(){
+	mRestarted.store(true, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+void DropoutCounter::blockStarted(){
+	mStartNs = monotonicNs();
+	if (mRestarted.exchange(false, std::memory_order_relaxed)){
+		mPreviousStartNs = 0;
+	}
+	if (mPreviousStartNs != 0 && 2 * (mStartNs - mPreviousStartNs) > 3 * mPeriodNs){
+		mLate.fetch_add(1, std::memory_order_relaxed);
+	}
+	mPreviousStartNs = mStartNs;
+}
+
+//--------------------------------------------------------------
+void DropoutCounter::blockFinished(size_t numFrames){
+	int64_t elapsed = monotonicNs() - mStartNs;
+	int64_t period = (numFrames > 0) ? int64_t(1e9 * numFrames / mSampleRate) : mPeriodNs;
+	if (elapsed > period){
+		mOverruns.fetch_add(1, std::memory_order_relaxed);
+	}
+	mLoad.store(period > 0 ? float(elapsed) / float(period) : 0.f, std::memory_order_relaxed);
+}
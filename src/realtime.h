@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef struct{
+	bool enabled = false;		// opt-in, --realtime
+	int priority = 70;			// SCHED_FIFO priority, 1-99
+	bool lockMemory = true;		// mlockall the whole process
+	std::vector<int> audioCpus;	// cores of the audio thread, empty: not pinned, -1: not a cpu
+	std::vector<int> workerCpus;// cores of the other threads (GUI, workers), same
+} s_realtime_settings;
+
+typedef struct{
+	uint64_t thread;	// pthread_t of the thread
+	long tid;			// kernel thread id, what rtkit expects
+} s_thread_handle;
+
+// Parses --realtime, --rt-priority=N, --no-mlock, --audio-cpus=2,3 and
+// --worker-cpus=0,1 from the command line. Unknown arguments are ignored.
+// The cpu lists take numbers and ranges, as in 0,2-3; an item that is
+// neither is kept as -1, for pinThread to report.
+s_realtime_settings parseRealtimeArguments(int argc, char* argv[]);
+
+s_thread_handle currentThread();
+s_thread_handle threadHandle(std::thread& thread);	// tid left at 0, enough for pinThread
+
+// steady clock in nanoseconds, the time base of the timestamps of the audio thread
+int64_t monotonicNs();
+
+// Each call returns false when it failed, with the reason appended to report.
+bool promoteToRealtime(const s_thread_handle& thread, int priority, std::string& report);	// SCHED_FIFO, rtkit as a fallback
+bool lockMemory(std::string& report);
+bool pinThread(const s_thread_handle& thread, const std::vector<int>& cpus, std::string& report);	// not at all if a cpu does not exist
+
+// touches the stack pages of the calling thread, so that the first audio
+// blocks do not take page faults on it
+void prefaultStack(size_t bytes);
+
+// Counts the blocks that probably dropped out: callbacks arriving later than
+// one and a half periods after the previous one, and blocks whose DSP took
+// longer than the period. Called from the audio thread, read from anywhere.
+class DropoutCounter{
+
+	public:
+
+		void setup(size_t bufferSize, size_t sampleRate);
+		void restart();	// the stream was stopped, the next callback is not late
+		void blockStarted();
+		void blockFinished(size_t numFrames = 0);	// the deadline of a block of numFrames, 0 for the bufferSize of setup()
+
+		int lateCallbacks() const { return mLate.load(std::memory_order_relaxed); }
+		int overruns() const { return mOverruns.load(std::memory_order_relaxed); }
+		float load() const { return mLoad.load(std::memory_order_relaxed); }	// DSP time / period of the last block
+
+	private:
+
+		int64_t mPeriodNs = 0;
+		size_t mSampleRate = 44100;
+		int64_t mStartNs = 0;
+		int64_t mPreviousStartNs = 0;
+		std::atomic<bool> mRestarted{false};
+		std::atomic<int> mLate{0};
+		std::atomic<int> mOverruns{0};
+		std::atomic<float> mLoad{0.f};
+};
@@ -0,0 +1,54 @@
+#include "scope.h"
+#include <algorithm>
+
+//--------------------------------------------------------------
+void ScopeHistory::setup(size_t length){
+	mSamples.assign(length, 0.f);
+	mWrite.store(0);
+}
+
+//--------------------------------------------------------------
+void ScopeHistory::write(const float* samples, size_t numFrames){
+	// odd generations mean a write is in progress
+	mGeneration.fetch_add(1, std::memory_order_acq_rel);
+	const size_t length = mSamples.size();
+	size_t write = mWrite.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < numFrames; i++){
+		mSamples[write] = samples[i];
+		write = (write + 1 == length) ? 0 : write + 1;
+	}
+	mWrite.store(write, std::memory_order_relaxed);
+	mGeneration.fetch_add(1, std::memory_order_release);
+}
+
+//--------------------------------------------------------------
+bool ScopeHistory::snapshot(std::vector<float>& samples) const {
+	uint64_t before = mGeneration.load(std::memory_order_acquire);
+	if (before & 1){
+		return false;
+	}
+	const size_t length = mSamples.size();
+	samples.resize(length);
+	size_t start = mWrite.load(std::memory_order_relaxed);
+	std::copy(mSamples.begin() + start, mSamples.end(), samples.begin());
+	std::copy(mSamples.begin(), mSamples.begin() + start, samples.begin() + (length - start));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return mGeneration.load(std::memory_order_relaxed) == before;
+}
+
+//--------------------------------------------------------------
+void decimateMinMax(const float* samples, size_t numSamples, size_t numColumns, float* mins, float* maxs){
+	for (size_t c = 0; c < numColumns; c++){
+		size_t begin = c * numSamples / numColumns;
+		size_t end = std::max(begin + 1, (c + 1) * numSamples / numColumns);
+		end = std::min(end, numSamples);
+		float low = samples[std::min(begin, numSamples - 1)];
+		float high = low;
+		for (size_t i = begin; i < end; i++){
+			low = std::min(low, samples[i]);
+			high = std::max(high, samples[i]);
+		}
+		mins[c] = low;
+		maxs[c] = high;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// History of the last samples of one signal, written by the audio thread
+// and read by the GUI thread. Every written block bumps the generation, so
+// the GUI only rebuilds its geometry when something new arrived.
+class ScopeHistory{
+
+	public:
+
+		void setup(size_t length);
+
+		void write(const float* samples, size_t numFrames);	// audio thread
+		uint64_t generation() const { return mGeneration.load(std::memory_order_acquire); }
+
+		// GUI thread: copies the history, oldest sample first. Returns false
+		// if a block was written meanwhile, the copy is then torn.
+		bool snapshot(std::vector<float>& samples) const;
+		size_t length() const { return mSamples.size(); }
+
+	private:
+
+		std::vector<float> mSamples;
+		std::atomic<size_t> mWrite{0};
+		std::atomic<uint64_t> mGeneration{0};
+};
+
+// Peak decimation: reduces numSamples samples to numColumns (min, max)
+// pairs, so a long history costs one column per pixel whatever its length.
+void decimateMinMax(const float* samples, size_t numSamples, size_t numColumns, float* mins, float* maxs);
@@ -0,0 +1,237 @@
+#include "shared_tap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//--------------------------------------------------------------
+s_tap_settings parseTapArguments(int argc, char* argv[]){
+	s_tap_settings settings;
+	for (int i = 1; i < argc; i++){
+		std::string argument = argv[i];
+		if (argument == "--tap"){
+			settings.enabled = true;
+		} else if (argument.rfind("--tap-name=", 0) == 0){
+			settings.name = argument.substr(strlen("--tap-name="));
+		} else if (argument.rfind("--tap-blocks=", 0) == 0){
+			settings.numSlots = std::max(2, atoi(argument.c_str() + strlen("--tap-blocks=")));
+		}
+	}
+	return settings;
+}
+
+//--------------------------------------------------------------
+static size_t slotStride(uint32_t numChannels, uint32_t slotFrames){
+	// slots are cache line aligned, so that a reader and the writer only
+	// share the lines of the slot they both look at
+	size_t bytes = sizeof(s_tap_slot) + sizeof(float) * numChannels * slotFrames;
+	return (bytes + 63) & ~size_t(63);
+}
+
+static size_t headerStride(){
+	return (sizeof(s_tap_header) + 63) & ~size_t(63);
+}
+
+static s_tap_slot* slotAt(void* memory, const s_tap_header* header, uint64_t block){
+	return reinterpret_cast<s_tap_slot*>(static_cast<char*>(memory) + headerStride() + (block % header->numSlots) * header->slotBytes);
+}
+
+//--------------------------------------------------------------
+SharedTapWriter::~SharedTapWriter(){
+	close();
+}
+
+//--------------------------------------------------------------
+bool SharedTapWriter::open(const std::string& name, uint32_t numChannels, uint32_t sampleRate, uint32_t slotFrames,
+	uint32_t numSlots, std::string& report){
+#ifdef __linux__
+	close();
+	numChannels = std::min<uint32_t>(numChannels, tapMaxChannels);
+	size_t stride = slotStride(numChannels, slotFrames);
+	mSize = headerStride() + stride * numSlots;
+	mName = (name.empty() || name[0] != '/') ? "/" + name : name;
+
+	// a new object every time, readers still mapping an old one keep it
+	// alive until they close it
+	shm_unlink(mName.c_str());
+	int fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0){
+		report += "tap: shm_open " + mName + " failed (" + std::string(strerror(errno)) + "). ";
+		return false;
+	}
+	if (ftruncate(fd, mSize) != 0){
+		report += "tap: could not size " + mName + " (" + std::string(strerror(errno)) + "). ";
+		::close(fd);
+		shm_unlink(mName.c_str());
+		return false;
+	}
+	mMemory = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mMemory == MAP_FAILED){
+		mMemory = nullptr;
+		report += "tap: mmap failed (" + std::string(strerror(errno)) + "). ";
+		shm_unlink(mName.c_str());
+		return false;
+	}
+
+	// ftruncate zero fills, so every slot starts with sequence 0: empty.
+	// The magic goes last, readers check it before anything else.
+	mHeader = new (mMemory) s_tap_header;
+	mHeader->version = tapVersion;
+	mHeader->numChannels = numChannels;
+	mHeader->sampleRate = sampleRate;
+	mHeader->numSlots = numSlots;
+	mHeader->slotFrames = slotFrames;
+	mHeader->slotBytes = stride;
+	mHeader->published.store(0, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < numSlots; i++){
+		new (slotAt(mMemory, mHeader, i)) s_tap_slot;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(mHeader->magic, "SYNTHTAP", 8);
+	mBlock = 0;
+	mFrame = 0;
+
+	report += "tap: /dev/shm" + mName + ", " + std::to_string(numSlots) + " blocks of " + std::to_string(slotFrames) + " frames. ";
+	return true;
+#else
+	report += "tap: shared memory is only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+void SharedTapWriter::close(){
+#ifdef __linux__
+	if (mMemory != nullptr){
+		munmap(mMemory, mSize);
+		shm_unlink(mName.c_str());
+	}
+#endif
+	mMemory = nullptr;
+	mHeader = nullptr;
+}
+
+//--------------------------------------------------------------
+void SharedTapWriter::publish(const float* const* channels, size_t numFrames){
+	if (mHeader == nullptr){
+		return;
+	}
+	const uint32_t numChannels = mHeader->numChannels;
+	for (size_t offset = 0; offset < numFrames; offset += mHeader->slotFrames){
+		uint32_t frames = (uint32_t) std::min<size_t>(mHeader->slotFrames, numFrames - offset);
+		s_tap_slot* slot = slotAt(mMemory, mHeader, mBlock);
+
+		slot->sequence.store(2 * mBlock + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		float* samples = reinterpret_cast<float*>(slot + 1);
+		for (uint32_t c = 0; c < numChannels; c++){
+			const float* in = channels[c] + offset;
+			float* out = samples + c * mHeader->slotFrames;
+			float peak = 0.f;
+			float sum = 0.f;
+			for (uint32_t i = 0; i < frames; i++){
+				out[i] = in[i];
+				peak = std::max(peak, std::fabs(in[i]));
+				sum += in[i] * in[i];
+			}
+			slot->peak[c] = peak;
+			slot->rms[c] = std::sqrt(sum / std::max<uint32_t>(frames, 1));
+		}
+		slot->firstFrame = mFrame;
+		slot->numFrames = frames;
+
+		slot->sequence.store(2 * mBlock + 2, std::memory_order_release);
+		mBlock++;
+		mFrame += frames;
+		mHeader->published.store(mBlock, std::memory_order_release);
+	}
+}
+
+//--------------------------------------------------------------
+SharedTapReader::~SharedTapReader(){
+	close();
+}
+
+//--------------------------------------------------------------
+bool SharedTapReader::open(const std::string& name, std::string& report){
+#ifdef __linux__
+	close();
+	std::string path = (name.empty() || name[0] != '/') ? "/" + name : name;
+	int fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0){
+		report += "no tap " + path + " (" + std::string(strerror(errno)) + "), run the synth with --tap. ";
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < headerStride()){
+		report += "tap " + path + " is not ready. ";
+		::close(fd);
+		return false;
+	}
+	mSize = info.st_size;
+	mMemory = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mMemory == MAP_FAILED){
+		mMemory = nullptr;
+		report += "mmap failed (" + std::string(strerror(errno)) + "). ";
+		return false;
+	}
+	mHeader = static_cast<const s_tap_header*>(mMemory);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	// any process may have written the object: the peaks and the samples
+	// of every slot have to lie where the header says, inside the mapping
+	if (memcmp(mHeader->magic, "SYNTHTAP", 8) != 0 || mHeader->version != tapVersion
+		|| mHeader->numChannels == 0 || mHeader->numChannels > tapMaxChannels
+		|| mHeader->numSlots == 0 || mHeader->slotFrames == 0
+		|| mHeader->slotBytes != slotStride(mHeader->numChannels, mHeader->slotFrames)
+		|| headerStride() + size_t(mHeader->slotBytes) * mHeader->numSlots > mSize){
+		report += "tap " + path + " has an unknown layout. ";
+		close();
+		return false;
+	}
+	return true;
+#else
+	report += "shared memory is only supported on Linux. ";
+	return false;
+#endif
+}
+
+//--------------------------------------------------------------
+void SharedTapReader::close(){
+#ifdef __linux__
+	if (mMemory != nullptr){
+		munmap(mMemory, mSize);
+	}
+#endif
+	mMemory = nullptr;
+	mHeader = nullptr;
+}
+
+//--------------------------------------------------------------
+const s_tap_slot* SharedTapReader::slot(uint64_t block, uint64_t& sequence) const {
+	const s_tap_slot* slot = slotAt(mMemory, mHeader, block);
+	sequence = slot->sequence.load(std::memory_order_acquire);
+	return (sequence == 2 * block + 2) ? slot : nullptr;
+}
+
+//--------------------------------------------------------------
+const float* SharedTapReader::samples(const s_tap_slot* slot, uint32_t channel) const {
+	return reinterpret_cast<const float*>(slot + 1) + channel * mHeader->slotFrames;
+}
+
+//--------------------------------------------------------------
+bool SharedTapReader::stillValid(const s_tap_slot* slot, uint64_t sequence) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
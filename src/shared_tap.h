@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the shared memory object, shared by the synth and its readers.
+// A header, then numSlots slots of one block each. Every slot carries its
+// own seqlock: its sequence is odd while the synth writes it, then becomes
+// 2 * (block + 1) for the block it holds. Readers never write anything, so
+// any number of them can follow the stream without slowing the synth down;
+// a reader that falls more than numSlots blocks behind notices it from the
+// sequences and skips ahead.
+static constexpr uint32_t tapVersion = 1;
+static constexpr size_t tapMaxChannels = 2;
+
+typedef struct{
+	char magic[8];						// "SYNTHTAP"
+	uint32_t version;
+	uint32_t numChannels;
+	uint32_t sampleRate;
+	uint32_t numSlots;
+	uint32_t slotFrames;				// capacity of a slot, in frames
+	uint32_t slotBytes;					// stride between slots
+	std::atomic<uint64_t> published;	// blocks written so far
+} s_tap_header;
+
+typedef struct{
+	std::atomic<uint64_t> sequence;
+	uint64_t firstFrame;				// position of the block in the stream
+	uint32_t numFrames;
+	float peak[tapMaxChannels];
+	float rms[tapMaxChannels];
+	// followed by numChannels planar arrays of slotFrames samples
+} s_tap_slot;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the tap needs address free atomics");
+
+typedef struct{
+	bool enabled = false;				// --tap
+	std::string name = "synthesizer_tap";	// --tap-name=, the object is /dev/shm/<name>
+	uint32_t numSlots = 256;			// --tap-blocks=, how far behind a reader may fall
+} s_tap_settings;
+
+s_tap_settings parseTapArguments(int argc, char* argv[]);
+
+// Writer side, owned by the synth. publish() is wait free and never
+// allocates: it copies the block into the next slot and moves on.
+class SharedTapWriter{
+
+	public:
+
+		~SharedTapWriter();
+
+		bool open(const std::string& name, uint32_t numChannels, uint32_t sampleRate, uint32_t slotFrames,
+			uint32_t numSlots, std::string& report);
+		void close();
+		bool isOpen() const { return mHeader != nullptr; }
+
+		// audio thread, blocks longer than a slot take several slots
+		void publish(const float* const* channels, size_t numFrames);
+
+	private:
+
+		std::string mName;
+		void* mMemory = nullptr;
+		size_t mSize = 0;
+		s_tap_header* mHeader = nullptr;
+		uint64_t mBlock = 0;
+		uint64_t mFrame = 0;
+};
+
+// Reader side, for the tools and any other process of the same machine.
+class SharedTapReader{
+
+	public:
+
+		~SharedTapReader();
+
+		bool open(const std::string& name, std::string& report);
+		void close();
+		const s_tap_header* header() const { return mHeader; }
+
+		// points at the slot of `block` if it still holds it, nullptr if it
+		// is not written yet or already overwritten. The samples are read in
+		// place: check with stillValid() once done with them.
+		const s_tap_slot* slot(uint64_t block, uint64_t& sequence) const;
+		const float* samples(const s_tap_slot* slot, uint32_t channel) const;
+		bool stillValid(const s_tap_slot* slot, uint64_t sequence) const;
+
+	private:
+
+		void* mMemory = nullptr;
+		size_t mSize = 0;
+		const s_tap_header* mHeader = nullptr;
+};
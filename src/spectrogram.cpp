@@ -0,0 +1,211 @@
+#include "spectrogram.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+//--------------------------------------------------------------
+s_spectrogram_settings parseSpectrogramArguments(int argc, char* argv[]){
+	s_spectrogram_settings settings;
+	bool hopGiven = false;
+	for (int i = 1; i < argc; i++){
+		std::string argument = argv[i];
+		if (argument.rfind("--stft-size=", 0) == 0){
+			size_t size = std::max(64, atoi(argument.c_str() + strlen("--stft-size=")));
+			settings.fftSize = 64;
+			while (settings.fftSize < size && settings.fftSize < 32768){
+				settings.fftSize *= 2;
+			}
+		} else if (argument.rfind("--stft-hop=", 0) == 0){
+			settings.hop = std::max(16, atoi(argument.c_str() + strlen("--stft-hop=")));
+			hopGiven = true;
+		} else if (argument.rfind("--stft-bands=", 0) == 0){
+			settings.numBands = std::clamp(atoi(argument.c_str() + strlen("--stft-bands=")), 8, 1024);
+		} else if (argument.rfind("--stft-smoothing=", 0) == 0){
+			settings.smoothing = std::clamp(float(atof(argument.c_str() + strlen("--stft-smoothing="))), 0.f, 0.99f);
+		}
+	}
+	if (!hopGiven){
+		settings.hop = settings.fftSize / 4;
+	}
+	settings.hop = std::min(settings.hop, settings.fftSize);
+	return settings;
+}
+
+//--------------------------------------------------------------
+Spectrogram::~Spectrogram(){
+	stop();
+}
+
+//--------------------------------------------------------------
+void Spectrogram::setup(size_t rate, const s_spectrogram_settings& settings){
+	stop();
+	sampleRate = rate;
+	mSettings = settings;
+	const size_t n = mSettings.fftSize;
+
+	// a second of input at least, so that the analysis thread may be late
+	size_t inputSize = 1;
+	while (inputSize < std::max(8 * n, sampleRate)){
+		inputSize *= 2;
+	}
+	mInput.assign(inputSize, 0.f);
+	mInputMask = inputSize - 1;
+	mInputWritten.store(0);
+	mNextStart = 0;
+
+	mFft.setup(n);
+	mRe.assign(n, 0.f);
+	mIm.assign(n, 0.f);
+	mWindow.resize(n);
+	double windowSum = 0.;
+	for (size_t i = 0; i < n; i++){
+		mWindow[i] = 0.5f - 0.5f * cosf(2.f * float(M_PI) * i / n);
+		windowSum += mWindow[i];
+	}
+	// a full scale sine peaks at |X| = windowSum / 2
+	mScale = float(4. / (windowSum * windowSum));
+
+	// logarithmic bands; the low ones, narrower than a bin, take the nearest bin
+	const int numBands = mSettings.numBands;
+	const float binWidth = float(sampleRate) / n;
+	mBandFirst.resize(numBands);
+	mBandLast.resize(numBands);
+	for (int b = 0; b < numBands; b++){
+		float low = bandFrequency(b);
+		float high = bandFrequency(b + 1);
+		int first = int(ceilf(low / binWidth));
+		int last = std::min(int(n / 2), int(floorf(high / binWidth)));
+		if (last < first){
+			first = last = std::min(int(n / 2), int(roundf(sqrtf(low * high) / binWidth)));
+		}
+		mBandFirst[b] = std::max(first, 1);
+		mBandLast[b] = std::max(last, 1);
+	}
+	mAverage.assign(numBands, 0.f);
+	mFrames.assign(historyFrames * frameBytes(), 0);
+	mFramesWritten.store(0);
+}
+
+//--------------------------------------------------------------
+float Spectrogram::bandFrequency(int band) const {
+	const float nyquist = 0.5f * sampleRate;
+	return mSettings.minFrequency * powf(nyquist / mSettings.minFrequency, float(band) / mSettings.numBands);
+}
+
+//--------------------------------------------------------------
+void Spectrogram::start(){
+	stop();
+	if (mInput.empty()){
+		return;
+	}
+	mStop.store(false);
+	mThread = std::thread(&Spectrogram::run, this);
+}
+
+//--------------------------------------------------------------
+void Spectrogram::stop(){
+	if (mThread.joinable()){
+		mStop.store(true);
+		mThread.join();
+	}
+}
+
+//--------------------------------------------------------------
+void Spectrogram::write(const float* left, const float* right, size_t numFrames){
+	uint64_t written = mInputWritten.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < numFrames; i++){
+		mInput[(written + i) & mInputMask] = 0.5f * (left[i] + right[i]);
+	}
+	mInputWritten.store(written + numFrames, std::memory_order_release);
+}
+
+//--------------------------------------------------------------
+void Spectrogram::run(){
+	const size_t n = mSettings.fftSize;
+	const size_t hop = mSettings.hop;
+	// a few wake ups per hop, whatever the block size of the audio thread
+	const auto period = std::chrono::microseconds(std::max<int64_t>(1000, int64_t(5e5 * hop / sampleRate)));
+	while (!mStop.load()){
+		uint64_t available = mInputWritten.load(std::memory_order_acquire);
+		// the audio thread overwrites the oldest half of the ring while it
+		// writes a block, only the newest half is read
+		if (available > mInput.size() / 2 && available - mInput.size() / 2 > mNextStart){
+			mNextStart = available - n;
+		}
+		while (mNextStart + n <= available && !mStop.load()){
+			if (!analyse(mNextStart)){
+				// lapped while copying, the next pass skips to the newest input
+				break;
+			}
+			mNextStart += hop;
+		}
+		std::this_thread::sleep_for(period);
+	}
+}
+
+//--------------------------------------------------------------
+bool Spectrogram::analyse(uint64_t start){
+	const size_t n = mSettings.fftSize;
+	for (size_t i = 0; i < n; i++){
+		mRe[i] = mWindow[i] * mInput[(start + i) & mInputMask];
+	}
+	// as in read(): the audio thread may be writing a block past the
+	// published count, the copy only holds if it stayed in the newest half
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (mInputWritten.load(std::memory_order_relaxed) > start + mInput.size() / 2){
+		return false;
+	}
+	std::fill(mIm.begin(), mIm.end(), 0.f);
+	mFft.forward(mRe.data(), mIm.data());
+
+	const int numBands = mSettings.numBands;
+	const float smoothing = mSettings.smoothing;
+	const float range = -mSettings.floorDb;
+	const uint64_t index = mFramesWritten.load(std::memory_order_relaxed);
+	uint8_t* frame = mFrames.data() + (index % historyFrames) * frameBytes();
+	for (int b = 0; b < numBands; b++){
+		// the loudest bin, so that a partial reads the same in wide and narrow bands
+		float power = 0.f;
+		for (int k = mBandFirst[b]; k <= mBandLast[b]; k++){
+			power = std::max(power, mRe[k] * mRe[k] + mIm[k] * mIm[k]);
+		}
+		mAverage[b] = smoothing * mAverage[b] + (1.f - smoothing) * mScale * power;
+		float decibels = 10.f * log10f(mAverage[b] + 1e-20f);
+		float v = std::clamp((decibels + range) / range, 0.f, 1.f);
+		// dark blue to yellow, the highest band on the first row
+		uint8_t* pixel = frame + 3 * (numBands - 1 - b);
+		pixel[0] = uint8_t(255.f * std::clamp(2.f * v - 0.4f, 0.f, 1.f));
+		pixel[1] = uint8_t(255.f * std::clamp(2.f * v - 1.f, 0.f, 1.f));
+		pixel[2] = uint8_t(255.f * std::clamp(v < 0.4f ? 1.5f * v : 1.f - 1.5f * (v - 0.4f), 0.f, 1.f));
+	}
+	mFramesWritten.store(index + 1, std::memory_order_release);
+	return true;
+}
+
+//--------------------------------------------------------------
+size_t Spectrogram::read(uint64_t& cursor, uint8_t* frames, size_t maxFrames) const {
+	const size_t bytes = frameBytes();
+	// the analysis thread may write a frame while this one copies, so the
+	// oldest half of the history is left alone
+	const uint64_t margin = historyFrames / 2;
+	uint64_t written = mFramesWritten.load(std::memory_order_acquire);
+	if (written > cursor + margin){
+		cursor = written - margin;
+	}
+	size_t count = size_t(std::min<uint64_t>(written - cursor, maxFrames));
+	for (size_t f = 0; f < count; f++){
+		const uint8_t* frame = mFrames.data() + ((cursor + f) % historyFrames) * bytes;
+		std::copy(frame, frame + bytes, frames + f * bytes);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (mFramesWritten.load(std::memory_order_relaxed) >= cursor + historyFrames){
+		// lapped during the copy, the GUI thread must have stalled
+		cursor = mFramesWritten.load(std::memory_order_relaxed);
+		return 0;
+	}
+	cursor += count;
+	return count;
+}
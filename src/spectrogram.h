@@ -0,0 +1,86 @@
+#pragma once
+#include "fft.h"
+#include "realtime.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef struct{
+	size_t fftSize = 2048;		// --stft-size=, a power of two
+	size_t hop = 512;			// --stft-hop=, frames between two transforms, 75% overlap by default
+	int numBands = 160;			// --stft-bands=, logarithmic from minFrequency to Nyquist
+	float smoothing = 0.5f;		// --stft-smoothing=, weight of the previous frame in the average, 0-1
+	float minFrequency = 30.f;
+	float floorDb = -96.f;		// mapped to 0, 0 dBFS to 1
+} s_spectrogram_settings;
+
+s_spectrogram_settings parseSpectrogramArguments(int argc, char* argv[]);
+
+// Scrolling spectrogram of a signal, computed by a thread of its own. The
+// audio thread only copies its samples into a ring; the analysis thread
+// wakes up a few times per hop, runs one Hann windowed transform per hop
+// available, bins the power in logarithmic bands, averages it with the
+// previous frames and stores the result, colour mapped, in a ring of frames
+// the GUI thread uploads as they are. The cost follows the hop rate, not
+// the frame rate.
+class Spectrogram{
+
+	public:
+
+		static constexpr size_t historyFrames = 512;	// frames kept for the GUI
+
+		~Spectrogram();
+
+		void setup(size_t sampleRate, const s_spectrogram_settings& settings);
+		void start();
+		void stop();
+		bool isRunning() const { return mThread.joinable(); }
+		s_thread_handle thread() { return threadHandle(mThread); }	// for pinThread, while running
+
+		// audio thread, wait free
+		void write(const float* left, const float* right, size_t numFrames);
+
+		// GUI thread: copies the frames produced since cursor, at most
+		// maxFrames of them, frameBytes() each, oldest first, and moves the
+		// cursor. Frames overwritten meanwhile are skipped. A frame is a
+		// column of RGB pixels, one per band, the highest band first, from
+		// dark blue at floorDb to yellow at 0 dBFS.
+		size_t read(uint64_t& cursor, uint8_t* frames, size_t maxFrames) const;
+		size_t frameBytes() const { return 3 * mSettings.numBands; }
+		uint64_t framesWritten() const { return mFramesWritten.load(std::memory_order_acquire); }
+		int numBands() const { return mSettings.numBands; }
+		float bandFrequency(int band) const;	// lower edge, Hz
+		float framesPerSecond() const { return float(sampleRate) / mSettings.hop; }
+
+	private:
+
+		void run();
+		bool analyse(uint64_t start);	// false when the input was overwritten during the copy
+
+		s_spectrogram_settings mSettings;
+		size_t sampleRate = 44100;
+
+		// samples, mono, written by the audio thread
+		std::vector<float> mInput;
+		size_t mInputMask = 0;
+		std::atomic<uint64_t> mInputWritten{0};
+
+		// analysis thread
+		Fft mFft;
+		std::vector<float> mWindow;
+		std::vector<float> mRe;
+		std::vector<float> mIm;
+		std::vector<int> mBandFirst;	// first and last bins of every band
+		std::vector<int> mBandLast;
+		std::vector<float> mAverage;	// power, exponentially averaged
+		float mScale = 1.f;				// from |X|^2 to the power of a full scale sine
+		uint64_t mNextStart = 0;		// input frame of the next transform
+		std::thread mThread;
+		std::atomic<bool> mStop{false};
+
+		// frames, written by the analysis thread
+		std::vector<uint8_t> mFrames;
+		std::atomic<uint64_t> mFramesWritten{0};
+};
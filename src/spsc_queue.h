@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded wait free queue between exactly one producer thread and one
+// consumer thread. Each side keeps a cached copy of the other side's index
+// and only reloads it when the queue looks full or empty, so in the steady
+// state push() and pop() touch no shared cache line but the item itself.
+template<typename T, size_t Capacity>
+class SpscQueue{
+
+	static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+	public:
+
+		// producer: false when full, the item is not queued
+		bool push(const T& item){
+			size_t write = mWrite.load(std::memory_order_relaxed);
+			if (write - mReadCache == Capacity){
+				mReadCache = mRead.load(std::memory_order_acquire);
+				if (write - mReadCache == Capacity){
+					return false;
+				}
+			}
+			mItems[write & (Capacity - 1)] = item;
+			mWrite.store(write + 1, std::memory_order_release);
+			return true;
+		}
+
+		// consumer: false when empty
+		bool pop(T& item){
+			size_t read = mRead.load(std::memory_order_relaxed);
+			if (read == mWriteCache){
+				mWriteCache = mWrite.load(std::memory_order_acquire);
+				if (read == mWriteCache){
+					return false;
+				}
+			}
+			item = mItems[read & (Capacity - 1)];
+			mRead.store(read + 1, std::memory_order_release);
+			return true;
+		}
+
+		size_t capacity() const { return Capacity; }
+
+	private:
+
+		alignas(64) std::atomic<size_t> mWrite{0};
+		size_t mReadCache = 0;		// producer side
+		alignas(64) std::atomic<size_t> mRead{0};
+		size_t mWriteCache = 0;		// consumer side
+		alignas(64) T mItems[Capacity];
+};
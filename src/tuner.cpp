@@ -0,0 +1,113 @@
+#include "tuner.h"
+#include <cmath>
+#include <algorithm>
+
+// damping of the sliding DFT, keeps the recursion stable despite rounding
+static const double damping = 0.99999;
+// periods of the target in a window: enough to separate two semitones
+static const int cyclesPerWindow = 20;
+// samples between the two states compared to measure the frequency
+static const size_t measureHop = 32;
+
+//--------------------------------------------------------------
+void NoteTuner::setup(size_t rate, int firstOctave, const std::vector<float>& targets){
+	sampleRate = rate;
+	mFirstOctave = firstOctave;
+	mBins.assign(targets.size(), s_bin());
+	mState.assign(targets.size(), 0.0);
+	mSnapshot.assign(targets.size(), 0.0);
+	mHistory.assign(historySize, 0.f);
+	mWrite = 0;
+
+	for (size_t b = 0; b < targets.size(); b++){
+		s_bin& bin = mBins[b];
+		double periods = double(sampleRate) / targets[b];
+		int cycles = std::max(1, std::min(cyclesPerWindow, int((historySize - 1) / periods)));
+		bin.length = std::min(int(historySize - 1), int(round(cycles * periods)));
+		bin.frequency = double(cycles) * sampleRate / bin.length;
+		bin.rotation = std::polar(damping, 2.0 * M_PI * cycles / bin.length);
+		bin.attenuation = pow(damping, bin.length);
+		bin.target = targets[b];
+		bin.scale = 2.0 * (1.0 - damping) / (1.0 - bin.attenuation);
+	}
+	for (auto& readout : mReadouts){
+		readout = s_note_readout{0.f, 0.f, firstOctave, false};
+	}
+}
+
+//--------------------------------------------------------------
+void NoteTuner::process(const float* left, const float* right, size_t numFrames){
+	if (mBins.empty() || numFrames == 0){
+		return;
+	}
+	const size_t mask = historySize - 1;
+	const size_t hop = std::min(measureHop, numFrames);
+	const size_t numBins = mBins.size();
+	for (size_t i = 0; i < numFrames; i++){
+		if (i == numFrames - hop){
+			std::copy(mState.begin(), mState.end(), mSnapshot.begin());
+		}
+		float x = 0.5f * (left[i] + right[i]);
+		mHistory[mWrite] = x;
+		for (size_t b = 0; b < numBins; b++){
+			const s_bin& bin = mBins[b];
+			float leaving = mHistory[(mWrite - bin.length) & mask];
+			mState[b] = bin.rotation * mState[b] + double(x) - bin.attenuation * leaving;
+		}
+		mWrite = (mWrite + 1) & mask;
+	}
+	publish(hop);
+}
+
+//--------------------------------------------------------------
+void NoteTuner::publish(size_t hop){
+	const int numBins = mBins.size();
+	mGeneration.fetch_add(1, std::memory_order_acq_rel);
+
+	for (int note = 0; note < notesPerOctave; note++){
+		int best = -1;
+		float bestLevel = 0.f;
+		for (int b = note; b < numBins; b += notesPerOctave){
+			float level = std::abs(mState[b]) * mBins[b].scale;
+			if (best < 0 || level > bestLevel){
+				best = b;
+				bestLevel = level;
+			}
+		}
+		s_note_readout& readout = mReadouts[note];
+		if (best < 0){
+			readout = s_note_readout{0.f, 0.f, mFirstOctave, false};
+			continue;
+		}
+
+		// the state of a bin turns by 2 pi f / sampleRate per sample, compare
+		// it with the rotation expected at the centre of the bin
+		const s_bin& bin = mBins[best];
+		double turned = std::arg(mState[best]) - std::arg(mSnapshot[best]);
+		double expected = 2.0 * M_PI * bin.frequency * hop / sampleRate;
+		double deviation = remainder(turned - expected, 2.0 * M_PI);
+		double measured = bin.frequency + deviation * sampleRate / (2.0 * M_PI * hop);
+
+		// leakage from another pitch is weaker than the pitch itself, and
+		// turns at the frequency of that pitch, more than half a semitone away
+		float below = (best > 0) ? std::abs(mState[best - 1]) * mBins[best - 1].scale : 0.f;
+		float above = (best + 1 < numBins) ? std::abs(mState[best + 1]) * mBins[best + 1].scale : 0.f;
+
+		readout.level = bestLevel;
+		readout.cents = (measured > 0.0) ? 1200.0 * log2(measured / bin.target) : 0.f;
+		readout.octave = mFirstOctave + best / notesPerOctave;
+		readout.sounding = bestLevel > threshold && bestLevel >= below && bestLevel >= above && fabsf(readout.cents) < 50.f;
+	}
+	mGeneration.fetch_add(1, std::memory_order_release);
+}
+
+//--------------------------------------------------------------
+bool NoteTuner::readouts(s_note_readout* readouts) const {
+	uint64_t before = mGeneration.load(std::memory_order_acquire);
+	if (before & 1){
+		return false;
+	}
+	std::copy(mReadouts, mReadouts + notesPerOctave, readouts);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return mGeneration.load(std::memory_order_relaxed) == before;
+}
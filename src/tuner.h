@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+typedef struct{
+	float level;	// amplitude of the strongest octave of the note
+	float cents;	// deviation of the measured frequency from the target
+	int octave;		// octave the level was measured in
+	bool sounding;
+} s_note_readout;
+
+// Bank of sliding DFT bins, one per equal-temperament pitch. Every bin is
+// updated with each incoming sample, so the whole bank costs O(bins) per
+// sample and a readout is available at the end of every block.
+class NoteTuner{
+
+	public:
+
+		static constexpr int notesPerOctave = 12;
+		static constexpr size_t historySize = 1 << 15;	// longest window, in samples
+
+		// targets holds the frequency of every pitch, from note 0 of
+		// firstOctave upwards, numOctaves * 12 values
+		void setup(size_t sampleRate, int firstOctave, const std::vector<float>& targets);
+
+		void process(const float* left, const float* right, size_t numFrames);	// audio thread
+
+		// GUI thread: copies the readouts of the 12 notes of the last block.
+		// Returns false if a block was published meanwhile, the copy is then
+		// torn, as ScopeHistory::snapshot.
+		bool readouts(s_note_readout* readouts) const;
+
+		float threshold = 0.003f;	// about -50 dBFS
+
+	private:
+
+		typedef struct{
+			std::complex<double> rotation;	// r * exp(j 2 pi k / N)
+			double attenuation;				// r^N, applied to the sample leaving the window
+			double frequency;				// centre frequency of the bin, k * sampleRate / N
+			float target;
+			float scale;					// 2 / N, turns |S| into an amplitude
+			int length;						// N
+		} s_bin;
+
+		void publish(size_t hop);
+
+		std::vector<s_bin> mBins;
+		std::vector<std::complex<double>> mState;
+		std::vector<std::complex<double>> mSnapshot;	// state mHop samples before the end of the block
+		std::vector<float> mHistory;
+		size_t mWrite = 0;
+		size_t sampleRate = 44100;
+		int mFirstOctave = 0;
+
+		s_note_readout mReadouts[notesPerOctave];
+		std::atomic<uint64_t> mGeneration{0};	// odd while publish() writes mReadouts
+};
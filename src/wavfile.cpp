@@ -0,0 +1,148 @@
+#include "wavfile.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+//--------------------------------------------------------------
+static uint32_t readLE(const unsigned char* p, int bytes){
+	uint32_t value = 0;
+	for (int i = 0; i < bytes; i++){
+		value |= uint32_t(p[i]) << (8 * i);
+	}
+	return value;
+}
+
+//--------------------------------------------------------------
+static void writeLE(std::ofstream& file, uint32_t value, int bytes){
+	for (int i = 0; i < bytes; i++){
+		file.put(char((value >> (8 * i)) & 0xFF));
+	}
+}
+
+//--------------------------------------------------------------
+static float decodeSample(const unsigned char* p, int bitsPerSample, bool isFloat){
+	if (isFloat){
+		float f;
+		std::memcpy(&f, p, sizeof(float));
+		return f;
+	}
+	switch (bitsPerSample){
+		case 16:
+			return int16_t(readLE(p, 2)) / 32768.f;
+		case 24:
+			// shift into the upper bytes so that the sign is preserved
+			return int32_t(readLE(p, 3) << 8) / 2147483648.f;
+		case 32:
+			return int32_t(readLE(p, 4)) / 2147483648.f;
+		default:
+			return 0.f;
+	}
+}
+
+//--------------------------------------------------------------
+bool loadWavMono(const std::string& path, std::vector<float>& samples, size_t& sampleRate){
+	std::ifstream file(path, std::ios::binary);
+	if (!file){
+		return false;
+	}
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.size() < 12 || std::memcmp(data.data(), "RIFF", 4) != 0 || std::memcmp(data.data() + 8, "WAVE", 4) != 0){
+		return false;
+	}
+
+	int numChannels = 0;
+	int bitsPerSample = 0;
+	bool isFloat = false;
+	size_t offset = 12;
+	while (offset + 8 <= data.size()){
+		const unsigned char* chunk = data.data() + offset;
+		size_t chunkSize = readLE(chunk + 4, 4);
+		size_t available = data.size() - offset - 8;
+		if (chunkSize > available){
+			chunkSize = available;
+		}
+		if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16){
+			int format = readLE(chunk + 8, 2);
+			numChannels = readLE(chunk + 10, 2);
+			sampleRate = readLE(chunk + 12, 4);
+			bitsPerSample = readLE(chunk + 22, 2);
+			// WAVE_FORMAT_EXTENSIBLE stores the real format in the sub-format GUID
+			if (format == 0xFFFE && chunkSize >= 26){
+				format = readLE(chunk + 32, 2);
+			}
+			isFloat = (format == 3);
+			// only what decodeSample reads: 16, 24 and 32 bit PCM, 32 bit float
+			bool supported = isFloat ? (bitsPerSample == 32) : (format == 1 && (bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32));
+			if (!supported || numChannels <= 0){
+				return false;
+			}
+		} else if (std::memcmp(chunk, "data", 4) == 0 && numChannels > 0){
+			int bytesPerSample = bitsPerSample / 8;
+			size_t frameBytes = size_t(bytesPerSample) * numChannels;
+			size_t numFrames = chunkSize / frameBytes;
+			samples.assign(numFrames, 0.f);
+			const unsigned char* p = chunk + 8;
+			for (size_t i = 0; i < numFrames; i++){
+				float sum = 0.f;
+				for (int c = 0; c < numChannels; c++){
+					sum += decodeSample(p, bitsPerSample, isFloat);
+					p += bytesPerSample;
+				}
+				samples[i] = sum / numChannels;
+			}
+			return numFrames > 0;
+		}
+		// chunks are padded to an even number of bytes
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+WavWriter::~WavWriter(){
+	close();
+}
+
+//--------------------------------------------------------------
+bool WavWriter::open(const std::string& path, int numChannels, size_t sampleRate){
+	close();
+	mFile.open(path, std::ios::binary | std::ios::trunc);
+	if (!mFile){
+		return false;
+	}
+	mNumChannels = numChannels;
+	mFrames = 0;
+	mFile.write("RIFF", 4);
+	writeLE(mFile, 0, 4);
+	mFile.write("WAVEfmt ", 8);
+	writeLE(mFile, 16, 4);
+	writeLE(mFile, 3, 2);	// IEEE float
+	writeLE(mFile, numChannels, 2);
+	writeLE(mFile, sampleRate, 4);
+	writeLE(mFile, sampleRate * numChannels * 4, 4);
+	writeLE(mFile, numChannels * 4, 2);
+	writeLE(mFile, 32, 2);
+	mFile.write("data", 4);
+	writeLE(mFile, 0, 4);
+	return bool(mFile);
+}
+
+//--------------------------------------------------------------
+void WavWriter::write(const float* interleaved, size_t numFrames){
+	// samples go out in host order, little endian on every target of the synth
+	mFile.write(reinterpret_cast<const char*>(interleaved), numFrames * mNumChannels * sizeof(float));
+	mFrames += numFrames;
+}
+
+//--------------------------------------------------------------
+void WavWriter::close(){
+	if (!mFile.is_open()){
+		return;
+	}
+	uint32_t dataBytes = uint32_t(mFrames * mNumChannels * sizeof(float));
+	mFile.seekp(4);
+	writeLE(mFile, 36 + dataBytes, 4);
+	mFile.seekp(40);
+	writeLE(mFile, dataBytes, 4);
+	mFile.close();
+}
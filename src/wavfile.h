@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+
+// Minimal RIFF/WAVE reader: PCM 16/24/32 bits and IEEE float 32 bits,
+// any other format is refused.
+// All channels are mixed down to a single mono track in [-1, 1].
+bool loadWavMono(const std::string& path, std::vector<float>& samples, size_t& sampleRate);
+
+// Streaming RIFF/WAVE writer, IEEE float 32 bits. The sizes in the header
+// are patched by close(), so a file cut short by a crash still has its
+// samples but advertises no length.
+class WavWriter{
+
+	public:
+
+		~WavWriter();
+
+		bool open(const std::string& path, int numChannels, size_t sampleRate);
+		void write(const float* interleaved, size_t numFrames);
+		void close();
+		size_t framesWritten() const { return mFrames; }
+
+	private:
+
+		std::ofstream mFile;
+		int mNumChannels = 0;
+		size_t mFrames = 0;
+};
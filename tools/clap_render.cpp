@@ -0,0 +1,319 @@
+// Offline CLAP host: loads a plugin, plays a few notes and parameter
+// changes at given samples through blocks of varying size, and writes the
+// result to a WAV file. It checks what a DAW relies on: the first note is
+// heard at its sample plus the reported latency, whatever the blocks, and
+// the output stays finite. The oscillators start at phase 0, so the first
+// sample of a note is silent and it is heard one sample later.
+//
+// The render is then done again with oversampling, set while the plugin is
+// active: the plugin must ask for a restart, report a longer latency after
+// it, and its output must match the first one delayed by the difference.
+//
+//   cmake -S . -B build -DCLAP_INCLUDE_DIR=path/to/clap/include && cmake --build build
+//   ./build/clap_render build/Synthesizer.clap out.wav [seconds] [--rate=48000] [--max-block=1024] [--oversampling=4]
+#include <clap/clap.h>
+#include "wavfile.h"
+#include <dlfcn.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef struct{
+	uint32_t frame;		// of the whole render
+	bool note;
+	bool on;
+	int key;
+	clap_id param;
+	double value;
+} s_scheduled_event;
+
+typedef struct{
+	size_t sampleRate;
+	uint32_t maxBlock;
+	int oversampling;	// factor, 1, 2, 4 or 8
+	uint32_t numFrames;
+} s_render_settings;
+
+typedef struct{
+	std::vector<float> left;
+	std::vector<float> right;
+	uint32_t latency;
+	size_t numBlocks;
+} s_render;
+
+typedef struct{
+	std::vector<clap_event_note_t> notes;
+	std::vector<clap_event_param_value_t> params;
+	std::vector<const clap_event_header_t*> headers;
+} s_event_list;
+
+// the index of the Oversampling parameter, its value is log2 of the factor
+static const clap_id oversamplingParam = 5;
+
+//--------------------------------------------------------------
+static bool option(const char* argument, const char* name, std::string& value){
+	size_t length = strlen(name);
+	if (strncmp(argument, name, length) != 0){
+		return false;
+	}
+	value = argument + length;
+	return true;
+}
+
+//--------------------------------------------------------------
+static bool renderPlugin(const clap_plugin_factory_t* factory, const clap_plugin_descriptor_t* descriptor,
+	const s_render_settings& settings, const std::vector<s_scheduled_event>& schedule, s_render& render){
+	bool restartRequested = false;
+	clap_host_t host = {
+		CLAP_VERSION_INIT, &restartRequested, "clap_render", "", "", "1.0.0",
+		[](const clap_host_t*, const char*) -> const void* { return nullptr; },
+		[](const clap_host_t* host){ *static_cast<bool*>(host->host_data) = true; },
+		[](const clap_host_t*){},
+		[](const clap_host_t*){},
+	};
+	const clap_plugin_t* plugin = factory->create_plugin(factory, &host, descriptor->id);
+	if (plugin == nullptr || !plugin->init(plugin) || !plugin->activate(plugin, double(settings.sampleRate), 1, settings.maxBlock)){
+		std::cerr << "could not activate " << descriptor->id << std::endl;
+		return false;
+	}
+	auto latencyExtension = static_cast<const clap_plugin_latency_t*>(plugin->get_extension(plugin, CLAP_EXT_LATENCY));
+	auto params = static_cast<const clap_plugin_params_t*>(plugin->get_extension(plugin, CLAP_EXT_PARAMS));
+	// no deadline here: the quality must not depend on the speed of the machine
+	auto renderExtension = static_cast<const clap_plugin_render_t*>(plugin->get_extension(plugin, CLAP_EXT_RENDER));
+	if (renderExtension != nullptr){
+		renderExtension->set(plugin, CLAP_RENDER_OFFLINE);
+	}
+
+	s_event_list events;
+	events.notes.reserve(schedule.size());
+	events.params.reserve(schedule.size() + 1);
+	clap_input_events_t inEvents = {
+		&events,
+		[](const clap_input_events_t* list) -> uint32_t { return static_cast<s_event_list*>(list->ctx)->headers.size(); },
+		[](const clap_input_events_t* list, uint32_t index){ return static_cast<s_event_list*>(list->ctx)->headers[index]; },
+	};
+	clap_output_events_t outEvents = {
+		nullptr,
+		[](const clap_output_events_t*, const clap_event_header_t*){ return true; },
+	};
+
+	if (settings.oversampling > 1){
+		// a change of latency while active, as a host would send it
+		uint32_t before = latencyExtension ? latencyExtension->get(plugin) : 0;
+		clap_event_header_t header = {sizeof(clap_event_param_value_t), 0, CLAP_CORE_EVENT_SPACE_ID, CLAP_EVENT_PARAM_VALUE, 0};
+		events.params.push_back({header, oversamplingParam, nullptr, -1, -1, -1, -1, log2(double(settings.oversampling))});
+		events.headers.push_back(&events.params.back().header);
+		if (params != nullptr){
+			params->flush(plugin, &inEvents, &outEvents);
+		}
+		if (!restartRequested){
+			std::cerr << "no restart requested after the oversampling changed" << std::endl;
+			return false;
+		}
+		plugin->deactivate(plugin);
+		if (!plugin->activate(plugin, double(settings.sampleRate), 1, settings.maxBlock)){
+			std::cerr << "could not restart " << descriptor->id << std::endl;
+			return false;
+		}
+		uint32_t after = latencyExtension ? latencyExtension->get(plugin) : 0;
+		std::cout << "oversampling " << settings.oversampling << "x: latency " << before << " -> " << after << " frames after the restart" << std::endl;
+	}
+	render.latency = latencyExtension ? latencyExtension->get(plugin) : 0;
+	if (!plugin->start_processing(plugin)){
+		std::cerr << "could not start " << descriptor->id << std::endl;
+		return false;
+	}
+
+	render.left.assign(settings.numFrames, 0.f);
+	render.right.assign(settings.numFrames, 0.f);
+	float* channels[2];
+	clap_audio_buffer_t output = {channels, nullptr, 2, 0, 0};
+	clap_process_t process;
+	memset(&process, 0, sizeof(process));
+	process.audio_outputs = &output;
+	process.audio_outputs_count = 1;
+	process.in_events = &inEvents;
+	process.out_events = &outEvents;
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint32_t> blockSizes(1, settings.maxBlock);
+	size_t next = 0;
+	uint32_t frame = 0;
+	render.numBlocks = 0;
+	while (frame < settings.numFrames){
+		uint32_t size = std::min(blockSizes(random), settings.numFrames - frame);
+		events.notes.clear();
+		events.params.clear();
+		events.headers.clear();
+		for (; next < schedule.size() && schedule[next].frame < frame + size; next++){
+			const s_scheduled_event& scheduled = schedule[next];
+			clap_event_header_t header = {0, scheduled.frame - frame, CLAP_CORE_EVENT_SPACE_ID, 0, 0};
+			if (scheduled.note){
+				header.size = sizeof(clap_event_note_t);
+				header.type = scheduled.on ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF;
+				events.notes.push_back({header, -1, 0, 0, int16_t(scheduled.key), 1.});
+				events.headers.push_back(&events.notes.back().header);
+			} else {
+				header.size = sizeof(clap_event_param_value_t);
+				header.type = CLAP_EVENT_PARAM_VALUE;
+				events.params.push_back({header, scheduled.param, nullptr, -1, -1, -1, -1, scheduled.value});
+				events.headers.push_back(&events.params.back().header);
+			}
+		}
+		channels[0] = render.left.data() + frame;
+		channels[1] = render.right.data() + frame;
+		process.steady_time = frame;
+		process.frames_count = size;
+		if (plugin->process(plugin, &process) == CLAP_PROCESS_ERROR){
+			std::cerr << "process failed at frame " << frame << std::endl;
+			return false;
+		}
+		frame += size;
+		render.numBlocks++;
+	}
+
+	plugin->stop_processing(plugin);
+	plugin->deactivate(plugin);
+	plugin->destroy(plugin);
+	return true;
+}
+
+//--------------------------------------------------------------
+int main(int argc, char* argv[]){
+	std::vector<std::string> positional;
+	s_render_settings settings = {48000, 1024, 4, 0};
+	for (int i = 1; i < argc; i++){
+		std::string value;
+		if (option(argv[i], "--rate=", value)){
+			settings.sampleRate = std::max(atoi(value.c_str()), 8000);
+		} else if (option(argv[i], "--max-block=", value)){
+			settings.maxBlock = std::max(atoi(value.c_str()), 1);
+		} else if (option(argv[i], "--oversampling=", value)){
+			settings.oversampling = 1;
+			while (settings.oversampling < atoi(value.c_str()) && settings.oversampling < 8){
+				settings.oversampling *= 2;
+			}
+		} else {
+			positional.push_back(argv[i]);
+		}
+	}
+	if (positional.size() < 2){
+		std::cerr << "usage: clap_render plugin.clap out.wav [seconds] [--rate=48000] [--max-block=1024] [--oversampling=4]" << std::endl;
+		return 1;
+	}
+	double seconds = std::max((positional.size() > 2) ? atof(positional[2].c_str()) : 4., 1.);
+
+	void* library = dlopen(positional[0].c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (library == nullptr){
+		std::cerr << dlerror() << std::endl;
+		return 1;
+	}
+	const clap_plugin_entry_t* entry = static_cast<const clap_plugin_entry_t*>(dlsym(library, "clap_entry"));
+	if (entry == nullptr || !entry->init(positional[0].c_str())){
+		std::cerr << "no clap_entry in " << positional[0] << std::endl;
+		return 1;
+	}
+	const clap_plugin_factory_t* factory = static_cast<const clap_plugin_factory_t*>(entry->get_factory(CLAP_PLUGIN_FACTORY_ID));
+	if (factory == nullptr || factory->get_plugin_count(factory) == 0){
+		std::cerr << "no plugin in " << positional[0] << std::endl;
+		return 1;
+	}
+	const clap_plugin_descriptor_t* descriptor = factory->get_plugin_descriptor(factory, 0);
+	std::cout << descriptor->name << " " << descriptor->version << std::endl;
+
+	// a chord, a cutoff sweep in steps and a change of wave shape, none of
+	// them on a block boundary
+	settings.numFrames = uint32_t(seconds * settings.sampleRate);
+	const uint32_t numFrames = settings.numFrames;
+	const uint32_t firstNote = 12345;
+	std::vector<s_scheduled_event> schedule = {
+		{firstNote, true, true, 60, 0, 0.},
+		{firstNote + 4801, true, true, 64, 0, 0.},
+		{firstNote + 9602, true, true, 67, 0, 0.},
+	};
+	for (int step = 0; step < 20; step++){
+		schedule.push_back({firstNote + 1000 + 977 * step, false, false, 0, 2, 200. + 300. * step});
+	}
+	schedule.push_back({numFrames / 2 + 7, false, false, 0, 4, 2.});
+	schedule.push_back({numFrames * 3 / 4 + 3, true, false, 60, 0, 0.});
+	std::sort(schedule.begin(), schedule.end(), [](const s_scheduled_event& a, const s_scheduled_event& b){ return a.frame < b.frame; });
+
+	s_render_settings reference = settings;
+	reference.oversampling = 1;
+	s_render render;
+	if (!renderPlugin(factory, descriptor, reference, schedule, render)){
+		return 1;
+	}
+	int64_t firstSound = -1;
+	float peak = 0.f;
+	bool finite = true;
+	for (uint32_t i = 0; i < numFrames; i++){
+		finite = finite && std::isfinite(render.left[i]) && std::isfinite(render.right[i]);
+		float magnitude = std::max(std::fabs(render.left[i]), std::fabs(render.right[i]));
+		if (firstSound < 0 && magnitude > 0.f){
+			firstSound = i;
+		}
+		peak = std::max(peak, magnitude);
+	}
+	WavWriter wav;
+	if (!wav.open(positional[1], 2, settings.sampleRate)){
+		std::cerr << "could not write " << positional[1] << std::endl;
+		return 1;
+	}
+	std::vector<float> interleaved(2 * numFrames);
+	for (uint32_t i = 0; i < numFrames; i++){
+		interleaved[2 * i] = render.left[i];
+		interleaved[2 * i + 1] = render.right[i];
+	}
+	wav.write(interleaved.data(), numFrames);
+	wav.close();
+
+	std::cout << render.numBlocks << " blocks of 1 to " << settings.maxBlock << " frames, latency " << render.latency
+		<< " frames, peak " << 20.f * log10(std::max(peak, 1e-10f)) << " dBFS" << std::endl;
+	const int64_t expected = firstNote + render.latency + 1;
+	std::cout << "first note at frame " << firstNote << ", heard from frame " << firstSound << " (expected " << expected << ")" << std::endl;
+	if (!finite || firstSound != expected){
+		std::cerr << (finite ? "the first note is not sample accurate" : "the output is not finite") << std::endl;
+		return 1;
+	}
+
+	if (settings.oversampling > 1){
+		// the decimation filters start answering before their group delay,
+		// so the delay is measured by correlation, over the chord before the
+		// change of wave shape; it is a fraction of a frame shorter than the
+		// reported one, which is rounded up
+		s_render oversampled;
+		if (!renderPlugin(factory, descriptor, settings, schedule, oversampled)){
+			return 1;
+		}
+		const int64_t reported = int64_t(oversampled.latency) - int64_t(render.latency);
+		const uint32_t begin = firstNote + 15000;
+		const uint32_t length = std::min<uint32_t>(8192, numFrames / 2 - begin - 256);
+		int bestLag = 0;
+		double bestCorrelation = -1e30;
+		for (int lag = 0; lag < 256; lag++){
+			double correlation = 0.;
+			for (uint32_t i = begin; i < begin + length; i++){
+				correlation += double(render.left[i]) * oversampled.left[i + lag];
+			}
+			if (correlation > bestCorrelation){
+				bestCorrelation = correlation;
+				bestLag = lag;
+			}
+		}
+		std::cout << "oversampled output delayed by " << bestLag << " frames, reported " << reported << std::endl;
+		if (reported <= 0 || std::abs(bestLag - reported) > 1){
+			std::cerr << "the latency reported with oversampling does not match the output" << std::endl;
+			return 1;
+		}
+	}
+
+	entry->deinit();
+	dlclose(library);
+	return 0;
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Local OSC sender for the synth server (--headless or --osc).
+
+    ./osc_send.py scale                    plays a chromatic octave
+    ./osc_send.py flood --rate 50000       note on/off pairs for a while,
+                                           to measure throughput and latency
+    ./osc_send.py send /filter/cutoff 800  one message, arguments typed
+                                           as int or float from their text
+
+Standard library only.
+"""
+import argparse
+import socket
+import struct
+import time
+
+
+def osc_string(text):
+    data = text.encode() + b"\0"
+    return data + b"\0" * (-len(data) % 4)
+
+
+def osc_message(address, *arguments):
+    tags = ","
+    payload = b""
+    for argument in arguments:
+        if isinstance(argument, int):
+            tags += "i"
+            payload += struct.pack(">i", argument)
+        elif isinstance(argument, float):
+            tags += "f"
+            payload += struct.pack(">f", argument)
+        else:
+            tags += "s"
+            payload += osc_string(str(argument))
+    return osc_string(address) + osc_string(tags) + payload
+
+
+def osc_bundle(messages):
+    # time tag 1 means "immediately"
+    data = osc_string("#bundle") + struct.pack(">Q", 1)
+    for message in messages:
+        data += struct.pack(">i", len(message)) + message
+    return data
+
+
+def parse_argument(text):
+    for kind in (int, float):
+        try:
+            return kind(text)
+        except ValueError:
+            pass
+    return text
+
+
+def scale(sock, target, args):
+    sock.sendto(osc_message("/volume", 0.2), target)
+    for pitch in range(args.first, args.first + 13):
+        sock.sendto(osc_message("/note/on", pitch), target)
+        time.sleep(args.duration)
+        sock.sendto(osc_message("/note/off", pitch), target)
+
+
+def flood(sock, target, args):
+    # messages go in bundles, one datagram per period of 1 ms
+    per_bundle = max(1, args.rate // 1000)
+    pitches = list(range(48, 60))
+    sent = 0
+    start = time.perf_counter()
+    next_send = start
+    while time.perf_counter() - start < args.seconds:
+        messages = []
+        for i in range(per_bundle):
+            pitch = pitches[(sent + i) % len(pitches)]
+            address = "/note/on" if (sent + i) % 2 == 0 else "/note/off"
+            messages.append(osc_message(address, pitch))
+        sock.sendto(osc_bundle(messages), target)
+        sent += per_bundle
+        next_send += 0.001
+        delay = next_send - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+    for pitch in pitches:
+        sock.sendto(osc_message("/note/off", pitch), target)
+    elapsed = time.perf_counter() - start
+    print("%d messages in %.2f s, %.0f messages/s" % (sent, elapsed, sent / elapsed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=9000)
+    commands = parser.add_subparsers(dest="command", required=True)
+    scale_parser = commands.add_parser("scale")
+    scale_parser.add_argument("--first", type=int, default=48)
+    scale_parser.add_argument("--duration", type=float, default=0.25)
+    flood_parser = commands.add_parser("flood")
+    flood_parser.add_argument("--rate", type=int, default=50000)
+    flood_parser.add_argument("--seconds", type=float, default=5.0)
+    send_parser = commands.add_parser("send")
+    send_parser.add_argument("address")
+    send_parser.add_argument("arguments", nargs="*")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    target = ("127.0.0.1", args.port)
+    if args.command == "scale":
+        scale(sock, target, args)
+    elif args.command == "flood":
+        flood(sock, target, args)
+    else:
+        sock.sendto(osc_message(args.address, *[parse_argument(a) for a in args.arguments]), target)
+
+
+if __name__ == "__main__":
+    main()
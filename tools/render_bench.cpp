@@ -0,0 +1,139 @@
+// Renders a chord through the engine, without openFrameworks nor an audio
+// device, and reports the cost of the blocks. The hot paths can be profiled
+// on their own (perf record ./render_bench ...), and SYNTH_DSP_ISA compares
+// the kernel variants.
+//
+//   cmake -S . -B build && cmake --build build
+//   ./build/render_bench [seconds] [--block=512] [--rate=44100] [--shape=saw]
+//       [--brillance=40] [--oversampling=1] [--notes=4] [--patch=file.bank:index] [--wav=out.wav]
+#include "engine.h"
+#include "wavfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+static bool option(const char* argument, const char* name, std::string& value){
+	size_t length = strlen(name);
+	if (strncmp(argument, name, length) != 0){
+		return false;
+	}
+	value = argument + length;
+	return true;
+}
+
+//--------------------------------------------------------------
+int main(int argc, char* argv[]){
+	double seconds = 10.;
+	size_t blockSize = 512;
+	size_t sampleRate = 44100;
+	WaveShape shape = WaveShape::Saw;
+	int brillance = 40;
+	int oversampling = 1;
+	int numNotes = 4;
+	std::string patchArgument;
+	std::string wavPath;
+	for (int i = 1; i < argc; i++){
+		std::string value;
+		if (option(argv[i], "--block=", value)){
+			blockSize = std::max(atoi(value.c_str()), 1);
+		} else if (option(argv[i], "--rate=", value)){
+			sampleRate = std::max(atoi(value.c_str()), 8000);
+		} else if (option(argv[i], "--shape=", value)){
+			shape = (value == "sin") ? WaveShape::Sin : (value == "square") ? WaveShape::Square : WaveShape::Saw;
+		} else if (option(argv[i], "--brillance=", value)){
+			brillance = std::max(atoi(value.c_str()), 1);
+		} else if (option(argv[i], "--oversampling=", value)){
+			oversampling = atoi(value.c_str());
+		} else if (option(argv[i], "--notes=", value)){
+			numNotes = std::min(std::max(atoi(value.c_str()), 0), SynthEngine::numNotes);
+		} else if (option(argv[i], "--patch=", value)){
+			patchArgument = value;
+		} else if (option(argv[i], "--wav=", value)){
+			wavPath = value;
+		} else {
+			seconds = atof(argv[i]);
+		}
+	}
+
+	SynthEngine engine;
+	engine.setup(blockSize, sampleRate);
+	engine.setWaveShape(shape);
+	engine.mBrillance = brillance;
+	engine.oversamplingFactor = 1;
+	while (engine.oversamplingFactor < oversampling && engine.oversamplingFactor < Oversampler::maxFactor){
+		engine.oversamplingFactor *= 2;
+	}
+	if (!patchArgument.empty()){
+		// applied directly, the loader thread is bypassed
+		size_t colon = patchArgument.rfind(':');
+		std::string path = patchArgument.substr(0, colon);
+		size_t index = (colon == std::string::npos) ? 0 : atoi(patchArgument.c_str() + colon + 1);
+		std::string report;
+		PatchBank bank;
+		s_prepared_patch prepared;
+		prepared.index = index;
+		if (!bank.open(path, report) || !bank.read(index, prepared.patch)){
+			std::cerr << "no patch " << index << " in " << path << " " << report << std::endl;
+			return 1;
+		}
+		clampPatch(prepared.patch, sampleRate);
+		prepared.lowFilter = engine.lowPassFilter(prepared.patch.lowFrequency, prepared.patch.lowQ);
+		prepared.highFilter = engine.highPassFilter(prepared.patch.highFrequency, prepared.patch.highQ);
+		engine.applyPatch(prepared);
+		std::cout << "patch " << index << ": " << prepared.patch.name << std::endl;
+	}
+	// a chord of stacked fifths from C of the current octave
+	for (int n = 0; n < numNotes; n++){
+		int pitch = engine.octaveIndex * 12 + 7 * n;
+		s_signal& signal = engine.signalsNotes[pitch % SynthEngine::numNotes];
+		signal.frequency = pitchToFrequency(pitch);
+		signal.volume = engine.volume;
+	}
+
+	WavWriter wav;
+	if (!wavPath.empty() && !wav.open(wavPath, 2, sampleRate)){
+		std::cerr << "could not write " << wavPath << std::endl;
+		return 1;
+	}
+	std::vector<float> left(blockSize), right(blockSize), interleaved(2 * blockSize);
+	float* outputs[2] = {left.data(), right.data()};
+	const size_t numBlocks = size_t(seconds * sampleRate / blockSize);
+	std::vector<double> durations;
+	durations.reserve(numBlocks);
+	for (size_t b = 0; b < numBlocks; b++){
+		auto start = std::chrono::steady_clock::now();
+		engine.renderBlock(outputs, 2, blockSize);
+		durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		if (!wavPath.empty()){
+			for (size_t i = 0; i < blockSize; i++){
+				interleaved[2 * i] = left[i];
+				interleaved[2 * i + 1] = right[i];
+			}
+			wav.write(interleaved.data(), blockSize);
+		}
+	}
+	wav.close();
+	engine.close();
+	if (durations.empty()){
+		return 0;
+	}
+
+	double total = 0.;
+	for (double duration : durations){
+		total += duration;
+	}
+	std::sort(durations.begin(), durations.end());
+	double period = 1e6 * blockSize / sampleRate;
+	double mean = total / durations.size();
+	std::cout << numBlocks << " blocks of " << blockSize << " frames at " << sampleRate << " Hz, kernels " << dspKernels().name << std::endl;
+	std::cout << "mean " << mean << " us, median " << durations[durations.size() / 2] << " us, 99% "
+		<< durations[durations.size() * 99 / 100] << " us, worst " << durations.back() << " us" << std::endl;
+	std::cout << "load " << 100. * mean / period << "% of the " << period << " us period, "
+		<< period / mean << "x realtime" << std::endl;
+	return 0;
+}
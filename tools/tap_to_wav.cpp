@@ -0,0 +1,137 @@
+// Records the shared memory tap of a running synth (--tap) to a WAV file,
+// and prints its peak/RMS meters once per second.
+//
+//   g++ -std=c++17 -O2 -I../src tap_to_wav.cpp ../src/shared_tap.cpp ../src/wavfile.cpp -o tap_to_wav -lrt
+//   ./tap_to_wav take.wav [seconds] [--tap-name=synthesizer_tap]
+//
+// The synth never waits for this reader: when it falls too far behind, the
+// lost blocks are counted and recording goes on from the oldest block still
+// available.
+#include "shared_tap.h"
+#include "wavfile.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static std::atomic<bool> stopRequested{false};
+
+//--------------------------------------------------------------
+static void onSignal(int){
+	stopRequested.store(true);
+}
+
+//--------------------------------------------------------------
+static float toDb(float value){
+	return 20.f * std::log10(std::max(value, 1e-6f));
+}
+
+//--------------------------------------------------------------
+int main(int argc, char* argv[]){
+	if (argc < 2){
+		std::cerr << "usage: " << argv[0] << " output.wav [seconds] [--tap-name=name]" << std::endl;
+		return 1;
+	}
+	std::string path = argv[1];
+	double seconds = 0.;
+	std::string name = s_tap_settings().name;
+	for (int i = 2; i < argc; i++){
+		if (strncmp(argv[i], "--tap-name=", 11) == 0){
+			name = argv[i] + 11;
+		} else {
+			seconds = atof(argv[i]);
+		}
+	}
+
+	std::string report;
+	SharedTapReader reader;
+	if (!reader.open(name, report)){
+		std::cerr << report << std::endl;
+		return 1;
+	}
+	const s_tap_header* header = reader.header();
+	const uint32_t numChannels = header->numChannels;
+	WavWriter wav;
+	if (!wav.open(path, numChannels, header->sampleRate)){
+		std::cerr << "could not write " << path << std::endl;
+		return 1;
+	}
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+	std::cout << "recording " << numChannels << " channels at " << header->sampleRate << " Hz to " << path
+		<< ", ctrl-c to stop" << std::endl;
+
+	const uint64_t maxFrames = seconds > 0. ? uint64_t(seconds * header->sampleRate) : UINT64_MAX;
+	std::vector<float> interleaved(size_t(header->slotFrames) * numChannels);
+	uint64_t block = header->published.load(std::memory_order_acquire);
+	uint64_t lost = 0;
+	float peak[tapMaxChannels] = {};
+	float rms[tapMaxChannels] = {};
+	auto lastMeter = std::chrono::steady_clock::now();
+
+	while (!stopRequested.load() && wav.framesWritten() < maxFrames){
+		uint64_t published = header->published.load(std::memory_order_acquire);
+		if (published < block){
+			std::cerr << "the synth restarted its tap" << std::endl;
+			break;
+		}
+		if (block == published){
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
+		}
+		// lapped: resume from the oldest block that cannot be overwritten
+		// before we get to it
+		if (published - block >= header->numSlots){
+			uint64_t resume = published - header->numSlots / 2;
+			lost += resume - block;
+			block = resume;
+		}
+
+		uint64_t sequence;
+		const s_tap_slot* slot = reader.slot(block, sequence);
+		if (slot == nullptr){
+			lost++;
+			block++;
+			continue;
+		}
+		uint32_t frames = std::min(slot->numFrames, header->slotFrames);
+		for (uint32_t c = 0; c < numChannels; c++){
+			const float* samples = reader.samples(slot, c);
+			for (uint32_t i = 0; i < frames; i++){
+				interleaved[i * numChannels + c] = samples[i];
+			}
+			peak[c] = std::max(peak[c], slot->peak[c]);
+			rms[c] = std::max(rms[c], slot->rms[c]);
+		}
+		if (!reader.stillValid(slot, sequence)){
+			lost++;
+			block++;
+			continue;
+		}
+		wav.write(interleaved.data(), frames);
+		block++;
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastMeter >= std::chrono::seconds(1)){
+			std::cout << "peak";
+			for (uint32_t c = 0; c < numChannels; c++){
+				std::cout << " " << toDb(peak[c]);
+			}
+			std::cout << " dB, rms";
+			for (uint32_t c = 0; c < numChannels; c++){
+				std::cout << " " << toDb(rms[c]);
+				peak[c] = rms[c] = 0.f;
+			}
+			std::cout << " dB, " << lost << " blocks lost" << std::endl;
+			lastMeter = now;
+		}
+	}
+	std::cout << wav.framesWritten() << " frames written, " << lost << " blocks lost" << std::endl;
+	wav.close();
+	return 0;
+}